@@ -0,0 +1,76 @@
+#ifndef _APNG_WRITER_H_
+#define _APNG_WRITER_H_
+
+#include "FrameSink.h"
+#include "ThreadPool.h"
+#include "savepng.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Writes captured frames as one animated PNG. Each frame is compared with
+// the previous one and only the rectangle of changed pixels is encoded;
+// frames identical to the one before extend its delay instead of being
+// stored again, so the lingering end frames cost nothing. Diffing and
+// encoding run in order on a background thread.
+class ApngWriter : public FrameSink
+{
+public:
+  ApngWriter(int framerate, const SDL_SavePNGOptions& options, size_t queueDepth = 4);
+  ~ApngWriter();
+
+  // target is the path of the .png or .apng file to write.
+  bool Open(const std::string& target) override;
+  void Close() override;
+
+  void Submit(const unsigned int* pixels, unsigned int w, unsigned int h) override;
+  void Wait() override;
+
+private:
+  typedef std::vector<unsigned int> Frame;
+
+  struct Rect
+  {
+    unsigned int X;
+    unsigned int Y;
+    unsigned int W;
+    unsigned int H;
+  };
+
+  void Process(std::shared_ptr<Frame> frame);
+  bool DirtyRect(const Frame& previous, const Frame& current, Rect& rect) const;
+  void WritePending();
+  void Recycle(std::shared_ptr<Frame> frame);
+
+  int m_framerate;
+  SDL_SavePNGOptions m_options;
+
+  // The file is opened up front; the APNG starts once the first frame has
+  // fixed the canvas size.
+  SDL_RWops* m_file;
+  SDL_APNGWriter* m_writer;
+  bool m_failed;
+
+  unsigned int m_width;
+  unsigned int m_height;
+
+  // The last distinct frame, top row first, and the part of it that still
+  // has to be written along with how many frames it lasts.
+  std::shared_ptr<Frame> m_previous;
+  Rect m_pending;
+  unsigned int m_pendingFrames;
+
+  ThreadPool m_encoder;
+  size_t m_queueDepth;
+  size_t m_inFlight;
+
+  std::vector<Frame> m_freeBuffers;
+
+  std::mutex m_mutex;
+  std::condition_variable m_slotFree;
+};
+
+#endif
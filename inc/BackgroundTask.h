@@ -0,0 +1,45 @@
+#ifndef _BACKGROUND_TASK_H_
+#define _BACKGROUND_TASK_H_
+
+#include "Progress.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// Runs one piece of work at a time on its own thread, so the event loop
+// stays responsive while it runs. The work is expected to poll the
+// Progress it is given and return early once it is cancelled.
+class BackgroundTask
+{
+public:
+  BackgroundTask();
+  ~BackgroundTask();
+
+  // Cancels and waits for any work still running, then starts work.
+  void Start(std::function<void(Progress&)> work);
+
+  // Asks running work to stop and waits for it to return.
+  void Cancel();
+
+  // Waits for running work to complete.
+  void Wait();
+
+  bool Running() const;
+
+  // Returns true once after work has run to completion without being
+  // cancelled. Never blocks.
+  bool Finished();
+
+  const Progress& Status() const { return m_progress; }
+
+private:
+  std::thread m_thread;
+  Progress m_progress;
+  std::atomic<bool> m_running;
+
+  // Work has been started whose result Finished hasn't reported yet.
+  bool m_uncollected;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _COLOR_CONVERT_H_
+#define _COLOR_CONVERT_H_
+
+namespace ColorConvert
+{
+  // Converts RGBA pixels, bottom row first as read back from the renderer,
+  // to planar 4:2:0 YUV (BT.601, limited range) of width x height. Both must
+  // be even. A source smaller than the output repeats its last row and
+  // column; a larger one is cropped to the top-left.
+  void RGBAToI420(const unsigned int* pixels, unsigned int srcW, unsigned int srcH,
+                  unsigned int width, unsigned int height,
+                  unsigned char* y, unsigned char* u, unsigned char* v);
+
+  // Name of the instruction set RGBAToI420 uses on this machine.
+  const char* InstructionSet();
+}
+
+#endif
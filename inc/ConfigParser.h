@@ -4,6 +4,7 @@
 #include "INIReader.h"
 #include "Util.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -13,6 +14,9 @@ struct WindowConfigType
   int Width;
   int Height;
   int Framerate;
+  std::string Backend;
+  int Threads;
+  bool Headless;
 };
 
 struct GeneralConfigType
@@ -20,6 +24,7 @@ struct GeneralConfigType
   int Generation;
   int Length;
   int LineWidth;
+  bool Antialias;
   bool Animate;
   float AnimateTime;
   float EndFrameTime;
@@ -33,20 +38,78 @@ struct GeneralConfigType
   Util::RGB Background;
   float Saturation;
   int Padding;
+  float FrameBudget;
+  int Preview;
+  float Lod;
+  bool Instancing;
+};
+
+struct OutputConfigType
+{
+  int Encoders;
+  int Compression;
+  std::string Filter;
+  int PngThreads;
+  std::string Palette;
+  std::string FrameFormat;
+  bool Mmap;
 };
 
 struct SystemConfigType
 {
   std::vector<std::pair<char, std::string>> Constants;
   std::string Axiom;
+  unsigned int Seed;
+  unsigned int KeepGenerations;
   std::map<char, std::vector<std::pair<float, std::string>>> Rules;
 };
 
+struct CacheConfigType
+{
+  std::string Directory;
+  int MaxSize;
+};
+
+struct SceneConfigType
+{
+  int Count;
+  int Variants;
+  unsigned int Seed;
+  int Width;
+  int Depth;
+  float MinScale;
+  float MaxScale;
+  float Tilt;
+};
+
+struct SweepConfigType
+{
+  std::string Parameter;
+  float Start;
+  float End;
+  int Frames;
+};
+
 struct ConfigurationType
 {
   WindowConfigType Window;
   GeneralConfigType General;
   SystemConfigType System;
+  OutputConfigType Output;
+  CacheConfigType Cache;
+  SceneConfigType Scene;
+  SweepConfigType Sweep;
+};
+
+// The earliest pipeline stage a configuration change invalidates, from
+// least to most work to redo.
+enum class ConfigChange
+{
+  None,
+  Redraw,       // colours, line width or animation timing
+  Reinterpret,  // turtle length, angle, rotation or placement
+  Generation,   // the generation count, over the same system
+  System        // constants, rules, axiom or seed
 };
 
 class ConfigParser
@@ -55,13 +118,26 @@ public:
   ConfigParser(std::string filename, ConfigurationType& config);
   ~ConfigParser() {}
 
+  // Whether the file was found and parsed without errors.
+  bool Valid() const { return m_valid; }
+
+  // Compares two configurations. Sections that can't be changed while
+  // running, [window], [output], [cache] and antialias, set restart instead.
+  static ConfigChange Compare(const ConfigurationType& before, const ConfigurationType& after, bool& restart);
+
 protected:
   void ParseWindowConfiguration(INIReader& ini, ConfigurationType& config);
   void ParseGeneralConfiguration(INIReader& ini, ConfigurationType& config);
   void ParseSystemConfiguration(INIReader& ini, ConfigurationType& config);
   void ParseRuleConfiguration(INIReader& ini, ConfigurationType& config);
+  void ParseOutputConfiguration(INIReader& ini, ConfigurationType& config);
+  void ParseCacheConfiguration(INIReader& ini, ConfigurationType& config);
+  void ParseSceneConfiguration(INIReader& ini, ConfigurationType& config);
+  void ParseSweepConfiguration(INIReader& ini, ConfigurationType& config);
 
   Util::RGB ParseColorString(std::string color);
+
+  bool m_valid;
 };
 
 #endif
\ No newline at end of file
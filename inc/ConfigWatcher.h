@@ -0,0 +1,32 @@
+#ifndef _CONFIG_WATCHER_H_
+#define _CONFIG_WATCHER_H_
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+// Notices when a file is rewritten. On Linux this watches the containing
+// directory with inotify, which also sees editors that save by renaming a
+// new file over the old one; elsewhere, or if inotify is unavailable, it
+// falls back to polling the modification time a few times a second.
+class ConfigWatcher
+{
+public:
+  ConfigWatcher(const std::string& path);
+  ~ConfigWatcher();
+
+  // Never blocks. Returns true once for each batch of changes since the
+  // previous call.
+  bool Changed();
+
+private:
+  bool ModifiedTimeChanged();
+
+  std::filesystem::path m_path;
+  std::filesystem::file_time_type m_modified;
+  std::chrono::steady_clock::time_point m_lastPoll;
+
+  int m_inotify;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef _CPU_RASTERIZER_H_
+#define _CPU_RASTERIZER_H_
+
+#include "ThreadPool.h"
+
+#include <vector>
+
+struct RasterLine
+{
+  float X1;
+  float Y1;
+  float X2;
+  float Y2;
+  unsigned int Color;
+};
+
+// Software line rasterizer. Lines are binned into square screen tiles which
+// are then drawn independently across the thread pool. Pixels are packed
+// RGBA (red in the low byte) with the bottom row first, matching what
+// glReadPixels returns for GL_RGBA/GL_UNSIGNED_INT_8_8_8_8_REV.
+class CpuRasterizer
+{
+public:
+  // A null pool rasterizes every tile on the calling thread. Antialiased
+  // lines are drawn as capsules with signed-distance coverage; otherwise
+  // they mimic GL aliased wide lines with square point caps.
+  CpuRasterizer(int width, int height, ThreadPool* pool, bool antialias = true);
+  ~CpuRasterizer() {}
+
+  void Clear(unsigned int color);
+  void DrawLines(const std::vector<RasterLine>& lines, float lineWidth);
+
+  void ReadPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int* pixels) const;
+
+  int Width() const { return m_width; }
+  int Height() const { return m_height; }
+
+  static unsigned int PackColor(float r, float g, float b, float a);
+
+  static const int TileSize = 64;
+
+private:
+  void RasterizeTile(size_t tile, const std::vector<RasterLine>& lines, float lineWidth);
+  void RasterizeTileAntialiased(size_t tile, const std::vector<RasterLine>& lines, float lineWidth);
+
+  int m_width;
+  int m_height;
+  int m_tilesX;
+  int m_tilesY;
+
+  std::vector<unsigned int> m_pixels;
+  std::vector<std::vector<unsigned int>> m_bins;
+
+  ThreadPool* m_pool;
+  bool m_antialias;
+};
+
+#endif
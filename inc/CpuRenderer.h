@@ -0,0 +1,38 @@
+#ifndef _CPU_RENDERER_H_
+#define _CPU_RENDERER_H_
+
+#include "LSystemRenderer.h"
+#include "CpuRasterizer.h"
+
+// Renders into a software framebuffer, so it needs neither a window nor a
+// GL context. Suitable for headless batch rendering.
+class CpuRenderer : public LSystemRenderer
+{
+public:
+  CpuRenderer(std::vector<LConstant>& axiom, const ConfigurationType& config);
+  ~CpuRenderer();
+
+  void Setup(bool toScreen = true) override;
+
+  void Clear() override;
+  void Present() override {}
+
+protected:
+  void DrawSegments(size_t begin, size_t end) override;
+  void DrawInstances() override;
+  bool ReadPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int* pixels) override;
+
+private:
+  CpuRasterizer m_rasterizer;
+
+  std::vector<RasterLine> m_lines;
+
+  // Animation frames redraw a growing prefix of the same geometry, so only
+  // the segments past what is already in the framebuffer get rasterized.
+  unsigned int m_drawnVersion;
+  size_t m_drawnSegments;
+  bool m_instancesDrawn;
+  bool m_clearPending;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef _EXPANSION_CACHE_H_
+#define _EXPANSION_CACHE_H_
+
+#include "ConfigParser.h"
+#include "LSystem.h"
+#include "Turtle.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk cache of expanded axioms and interpreted geometry, addressed by a
+// hash of everything that produced them. Axioms are stored one byte per
+// symbol and geometry as its raw segment array, both read back through a
+// memory mapping. Hits refresh a file's modification time, and once the
+// directory grows past its size limit the least recently used files go.
+class ExpansionCache
+{
+public:
+  ExpansionCache(const CacheConfigType& config);
+  ~ExpansionCache() {}
+
+  bool Enabled() const;
+
+  // Key for generation n of the system, or 0 when the expansion can't be
+  // reproduced: stochastic rules without a configured seed.
+  static uint64_t AxiomKey(const SystemConfigType& system, unsigned int generation);
+
+  // Key for the turtle's interpretation of an axiom from an origin.
+  static uint64_t GeometryKey(uint64_t axiomKey, const GeneralConfigType& general, float originX, float originY);
+
+  bool LoadAxiom(uint64_t key, const std::vector<LConstant>& constants, std::vector<LConstant>& axiom);
+  void StoreAxiom(uint64_t key, const std::vector<LConstant>& axiom);
+
+  bool LoadGeometry(uint64_t key, Geometry& geometry);
+  void StoreGeometry(uint64_t key, const Geometry& geometry);
+
+private:
+  std::string Path(uint64_t key, const char* extension) const;
+  bool Write(const std::string& path, const void* header, size_t headerSize, const void* data, size_t dataSize);
+  void Touch(const std::string& path);
+  void Evict();
+
+  std::string m_directory;
+  uint64_t m_maxBytes;
+
+  // Size of the directory as of the last scan, plus what has been stored
+  // since. Other runs sharing it can make this low, so eviction rescans.
+  std::atomic<uint64_t> m_bytes;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _FRAME_ENCODER_H_
+#define _FRAME_ENCODER_H_
+
+#include "ConfigParser.h"
+#include "ImageWriter.h"
+#include "ThreadPool.h"
+#include "savepng.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Writes captured frames on a pool of encoder threads so the render thread
+// only pays for a copy. At most queueDepth frames are in flight; Submit
+// blocks beyond that. Pixel buffers are recycled between frames.
+//
+// The format follows the file extension (see ImageWriter). Uncompressed
+// formats skip the pool and are written straight from the caller's pixels.
+class FrameEncoder
+{
+public:
+  // An encoder count of 0 uses one per hardware core. A queue depth of 0
+  // allows two frames in flight per encoder.
+  FrameEncoder(const OutputConfigType& config, size_t queueDepth = 0);
+  ~FrameEncoder();
+
+  // pixels are RGBA, bottom row first, as read back from the renderer.
+  void Submit(const std::string& filepath, const unsigned int* pixels, unsigned int w, unsigned int h);
+
+  // Blocks until every submitted frame has been written.
+  void Wait();
+
+  static bool Write(const std::string& filepath, ImageWriter::Format format, const unsigned int* pixels, unsigned int w, unsigned int h, const SDL_SavePNGOptions& options, bool mapped);
+  static bool WritePNG(const std::string& filepath, const unsigned int* pixels, unsigned int w, unsigned int h, const SDL_SavePNGOptions& options);
+
+  static SDL_SavePNGOptions PNGOptions(const OutputConfigType& config);
+
+private:
+  std::vector<unsigned int> AcquireBuffer(size_t size);
+  void ReleaseBuffer(std::vector<unsigned int>&& buffer);
+
+  SDL_SavePNGOptions m_options;
+  bool m_mapped;
+
+  // pngthreads was left to choose: a frame encoded while others are in
+  // flight keeps to one thread, since the pool already fills the cores.
+  bool m_autoThreads;
+
+  ThreadPool m_pool;
+  size_t m_queueDepth;
+  size_t m_inFlight;
+
+  std::vector<std::vector<unsigned int>> m_freeBuffers;
+
+  std::mutex m_mutex;
+  std::condition_variable m_slotFree;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _FRAME_SINK_H_
+#define _FRAME_SINK_H_
+
+#include <string>
+
+// Receives an animation one captured frame at a time, in order.
+class FrameSink
+{
+public:
+  virtual ~FrameSink() {}
+
+  virtual bool Open(const std::string& target) = 0;
+  virtual void Close() = 0;
+
+  // pixels are RGBA, bottom row first, as read back from the renderer. The
+  // first frame sets the size; later frames are cropped or padded to it.
+  virtual void Submit(const unsigned int* pixels, unsigned int w, unsigned int h) = 0;
+
+  // Blocks until every submitted frame has been written.
+  virtual void Wait() = 0;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef _GL_RENDERER_H_
+#define _GL_RENDERER_H_
+
+#include "LSystemRenderer.h"
+#include "PixelReadback.h"
+
+#include "SDL.h"
+#include <memory>
+
+// Draws with the fixed function pipeline into the window's back buffer, or
+// into an offscreen framebuffer object when not displaying or drawing
+// progressively. window may be null when running on a headless context.
+class GLRenderer : public LSystemRenderer
+{
+public:
+  GLRenderer(SDL_Window* window, std::vector<LConstant>& axiom, const ConfigurationType& config);
+  ~GLRenderer();
+
+  void Setup(bool toScreen = true) override;
+
+  void Clear() override;
+  void Present() override;
+
+  bool SetView(const View& view) override;
+
+  // Whether the current context can draw InstancedGeometry, which needs
+  // instanced arrays and GLSL from OpenGL 3.3.
+  static bool InstancingSupported();
+
+protected:
+  void DrawSegments(size_t begin, size_t end) override;
+  void DrawInstances() override;
+  bool ReadPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int* pixels) override;
+  bool ReadPixelsAsync(unsigned int x, unsigned int y, unsigned int w, unsigned int h, PixelCallback callback) override;
+  void FlushReads() override;
+
+private:
+  void DrawLine(float x1, float y1, float x2, float y2);
+  bool CreateFramebuffer();
+  void SelectReadBuffer();
+  void ApplyView();
+  void ClampLineWidth();
+
+  // Copies the geometry and its colours into m_vertexBuffer if they have
+  // changed since the last upload.
+  void Upload();
+
+  bool CreateInstanceProgram();
+  void UploadInstances();
+
+  SDL_Window* m_window;
+
+  unsigned int m_framebuffer;
+  unsigned int m_colorbuffer;
+
+  // Segments stay on the GPU between frames, so panning and zooming only
+  // changes the modelview matrix. Zero if vertex buffers are unsupported.
+  unsigned int m_vertexBuffer;
+  unsigned int m_uploadedVersion;
+  bool m_uploaded;
+
+  // Meshes and placements of m_instanced, drawn by a small shader that
+  // turns each mesh into place and colours it along the curve.
+  unsigned int m_instanceProgram;
+  unsigned int m_meshBuffer;
+  unsigned int m_instanceBuffer;
+  unsigned int m_instancesVersion;
+  bool m_instancesUploaded;
+
+  std::unique_ptr<PixelReadback> m_readback;
+
+  // Whether the back buffer holds the current image. After a swap only the
+  // front buffer is guaranteed to.
+  bool m_backBufferDrawn;
+
+  // Whether a framebuffer object is copied to the window on Present.
+  bool m_toScreen;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _HEADLESS_CONTEXT_H_
+#define _HEADLESS_CONTEXT_H_
+
+// An OpenGL context with no window or display server behind it. On Linux
+// builds with USE_EGL defined this is a surfaceless EGL context, which Mesa
+// backs with llvmpipe when there is no GPU. Rendering has to go to an FBO.
+class HeadlessContext
+{
+public:
+  HeadlessContext();
+  ~HeadlessContext();
+
+  bool Create();
+  void Destroy();
+
+  bool Valid() const;
+
+private:
+  void* m_display;
+  void* m_context;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _IMAGE_WRITER_H_
+#define _IMAGE_WRITER_H_
+
+#include <string>
+
+// Writers for intermediate frame formats that skip deflate entirely. All
+// take RGBA pixels bottom row first, as read back from the renderer, and
+// write them top row first.
+namespace ImageWriter
+{
+  enum class Format : unsigned char
+  {
+    PNG = 0,
+    QOI = 1,  // Quite OK Image format, lossless and several times faster than PNG
+    PPM = 2,  // binary P6, RGB
+    PAM = 3,  // P7, RGB_ALPHA
+    RAW = 4   // 16-byte header ("LRAW", then width, height and channels as
+              // little-endian uint32) followed by RGBA rows
+  };
+
+  // Picks the format from the file extension, defaulting to PNG.
+  Format FromPath(const std::string& path);
+  const char* Extension(Format format);
+
+  // Uncompressed formats are plain copies of the pixels and are cheap enough
+  // to write from the readback buffer directly.
+  bool IsUncompressed(Format format);
+
+  // With mapped set the file is preallocated, memory-mapped and filled in
+  // place; otherwise rows are streamed with stdio.
+  bool WriteUncompressed(const std::string& path, Format format, const unsigned int* pixels, unsigned int w, unsigned int h, bool mapped);
+  bool WriteQOI(const std::string& path, const unsigned int* pixels, unsigned int w, unsigned int h, bool mapped);
+}
+
+#endif
@@ -3,10 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <unordered_map>
 #include <random>
 
 #include "ConfigParser.h"
+#include "Progress.h"
 
 enum class ActionEnum : unsigned char
 {
@@ -75,15 +77,79 @@ public:
   bool SetAxiom(std::string axiom);
   bool SetConstantRule(char value, float weight, std::string rule);
 
-  std::vector<LConstant> GenerateNthAxiom(unsigned int n);
+  // Generations are kept on a ladder as they are derived, so generation n
+  // continues from the highest one already known below it, and anything at
+  // or below the last one asked for is returned without expanding again.
+  // With a seed configured the result for n is the same on every run.
+  // Given progress, expansion reports to it and gives up with an empty
+  // axiom once it is cancelled.
+  std::vector<LConstant> GenerateNthAxiom(unsigned int n, Progress* progress = NULL);
+
+  // As GenerateNthAxiom, but hands generation n over rather than copying it,
+  // leaving only the original axiom on the ladder.
+  std::vector<LConstant> ReleaseNthAxiom(unsigned int n, Progress* progress = NULL);
+
+  // Whether generations below the last one asked for stay on the ladder, as
+  // many as configured, for stepping down to. Without, only the last one
+  // does, so that expanding on from it still needs no work. On by default.
+  void RetainGenerations(bool retain);
+
+  // Expands generation n from seed as GenerateNthAxiom would with that seed
+  // configured, but from the axiom every time and without touching the
+  // ladder, so that any number of seeds can expand at once on different
+  // threads over the same rules.
+  std::vector<LConstant> GenerateNthAxiom(unsigned int n, unsigned int seed, Progress* progress = NULL) const;
+
+  // Forgets every derived generation. Without a seed, stochastic rules then
+  // choose again on the next GenerateNthAxiom.
+  void ClearGenerations();
+
+  // Whether generation n always expands to the same axiom: there is a seed
+  // or no rule is left to chance.
+  bool Reproducible() const;
+
+  // Whether every constant has a single rule that always applies, so that
+  // each symbol expands the same way wherever it appears.
+  bool Deterministic() const;
+
+  // The expansion of c's only rule, or NULL if c has no rule. Only
+  // meaningful for a Deterministic system.
+  const std::vector<LConstant>* Successor(const LConstant& c) const;
+
+  const std::vector<LConstant>& Axiom() const;
+
+  const std::vector<LConstant>& Constants() const;
 
   void Print();
 
 private:
   bool SplitStringIntoConstants(std::string input, std::vector<LConstant>& outputVec);
 
+  struct Generation;
+
+  // Derives generation n onto the ladder and returns its rung, or NULL if
+  // cancelled.
+  Generation* Climb(unsigned int n, Progress* progress);
+  // Returns false if cancelled. done and share place this generation within
+  // the overall progress.
+  bool Expand(const std::vector<LConstant>& input, std::vector<LConstant>& output, std::mt19937& generator,
+    Progress* progress, float done, float share) const;
+
+  struct Generation
+  {
+    std::vector<LConstant> Axiom;
+
+    // Random state after this generation was chosen, so the next one picks
+    // up exactly where a full expansion would have.
+    std::mt19937 Generator;
+  };
+
   std::mt19937 m_generator;
-  std::uniform_real_distribution<float> m_distribution;
+  unsigned int m_seed;
+
+  std::map<unsigned int, Generation> m_generations;
+  unsigned int m_keepGenerations;
+  bool m_retainGenerations;
 
   std::vector<LConstant> m_axiom;
   std::vector<LConstant> m_constants;
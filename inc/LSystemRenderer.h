@@ -2,48 +2,178 @@
 #define _LSYSTEM_RENDERER_H_
 
 #include "LSystem.h"
+#include "LevelOfDetail.h"
 #include "ConfigParser.h"
+#include "ExpansionCache.h"
+#include "FrameEncoder.h"
+#include "FrameSink.h"
+#include "PixelReadback.h"
+#include "Progress.h"
+#include "ThreadPool.h"
+#include "Turtle.h"
 #include "Util.h"
 
-#include "SDL.h"
 #include <memory>
-#include <stack>
 
-#define PI 3.14159265358979323846
-
-struct RendererState
+// How a level of detail image is looked at: scaled by Zoom about the middle
+// of the window, then moved X, Y pixels.
+struct View
 {
-  int   X;
-  int   Y;
-  float Rotation;
+  float Zoom;
+  float X;
+  float Y;
+
+  View() : Zoom(1.0f), X(0.0f), Y(0.0f) {}
 };
 
 class LSystemRenderer
 {
 public:
-  LSystemRenderer(SDL_Window* window, std::vector<LConstant>& axiom, const ConfigurationType& config);
-  ~LSystemRenderer();
+  LSystemRenderer(int width, int height, std::vector<LConstant>& axiom, const ConfigurationType& config);
+  virtual ~LSystemRenderer();
 
   void Center();
-  void SetupGL(bool toScreen = true);
+  virtual void Setup(bool toScreen = true) = 0;
   void SetupRender();
   bool Render();
   bool RenderNextSteps(int steps = 1);
 
+  // Moves how far into the axiom the next RenderNextSteps starts, forwards
+  // or back, without drawing. Frames draw from geometry already walked in
+  // full, so any frame can be reached without drawing those before it.
+  void SeekSteps(int steps);
+
+  // Draws as many segments as fit in the time budget on top of what earlier
+  // calls drew, starting over from a cleared image whenever the geometry or
+  // style changes. Returns true once every segment has been drawn.
+  bool RenderProgressive(float milliseconds);
+
+  virtual void Clear() = 0;
+  virtual void Present() = 0;
+
   void SetOrigin(float x, float y);
 
+  // Shows what has been drawn through view, zoomed and panned on top of
+  // wherever the geometry already is, without interpreting it again.
+  // Returns false if the backend can't, in which case the view is unchanged.
+  virtual bool SetView(const View& view) { return false; }
+
+  // Extent of the current geometry before any view is applied.
+  void Bounds(float& minX, float& minY, float& maxX, float& maxY) const;
+
+  // Picks up new colours and line width after the configuration has changed
+  // underneath the renderer, and draws from the start again.
+  void Restyle();
+
+  // Interprets axiom from the configured origin, centred if configured,
+  // without touching the geometry being drawn, so it may run on another
+  // thread meanwhile. Returns false if progress was cancelled. Adopt then
+  // swaps the result in on the rendering thread; the axiom drawn must be
+  // the one it was prepared from. scale multiplies the segment length, as
+  // for a preview of a coarser generation.
+  bool Prepare(const std::vector<LConstant>& axiom, uint64_t axiomKey, Geometry& geometry, float& x, float& y, Progress* progress, float scale = 1.0f) const;
+  void Adopt(Geometry& geometry, float x, float y, uint64_t axiomKey);
+
+  // Prepares generation n of a deterministic system straight from its
+  // rules with LevelOfDetail, collapsing whatever is smaller than the
+  // configured lod in pixels. Segments are sized so the image fills most of
+  // the window at any generation, in place of the configured length, and
+  // the image is then zoomed and panned by view. Only subtrees that reach
+  // into the window are walked, so the cost stays about the same however
+  // far in the view is zoomed.
+  bool PrepareLevelOfDetail(const LSystem& system, unsigned int n, const View& view, Geometry& geometry, float& x, float& y, Progress* progress) const;
+
+  // Prepares generation n of a deterministic system straight from its
+  // rules with LevelOfDetail::Instance, at the configured length and
+  // centred if configured. AdoptInstances hands the placed subtrees over
+  // after Adopt has taken the rest of the geometry; Adopt alone drops them.
+  bool PrepareInstanced(const LSystem& system, unsigned int n, Geometry& geometry, InstancedGeometry& instanced, float& x, float& y, Progress* progress) const;
+  void AdoptInstances(InstancedGeometry& instanced);
+
+  // Prepares a scene of the configured number of copies of generation n,
+  // as InstancedGeometry with one mesh per variant. A system with weighted
+  // rules is expanded and interpreted once per variant, each with its own
+  // seed; the copies are then scattered, scaled and tilted from the scene's
+  // seed. Handed over with AdoptInstances, as for PrepareInstanced.
+  bool PrepareScene(const LSystem& system, unsigned int n, Geometry& geometry, InstancedGeometry& instanced, float& x, float& y, Progress* progress) const;
+
+  // Expands generation n once for each of count seeds from seed, spread
+  // across pool if given, and interprets each from the origin with the
+  // configured length times scale. Every expansion reads the same rules.
+  bool PrepareVariants(const LSystem& system, unsigned int n, unsigned int seed, unsigned int count, float scale, ThreadPool* pool,
+    std::vector<Geometry>& variants, Progress* progress) const;
+
+  // Moves geometry interpreted from the origin to the configured origin,
+  // centred if configured, returning where that origin ended up.
+  void Position(Geometry& geometry, float& x, float& y) const;
+
+  // Interprets axiom for frame of the configured sweep, with the swept
+  // parameter in place of its configured value, then positions it as
+  // Position does. Several frames may be prepared at once on different
+  // threads.
+  bool PrepareSweep(const std::vector<LConstant>& axiom, unsigned int frame, Geometry& geometry, float& x, float& y, Progress* progress) const;
+
+  // Lays variants out in a grid filling the window, each scaled to fit its
+  // cell, as InstancedGeometry to hand over with AdoptInstances.
+  bool PrepareAtlas(const std::vector<Geometry>& variants, Geometry& geometry, InstancedGeometry& instanced) const;
+
   void SetAxiom(std::vector<LConstant>& axiom);
 
-  bool SaveScreenshot(const std::string& filename, int padding = 20);
+  // Lets Interpret reuse cached geometry for the current axiom, identified
+  // by its ExpansionCache key. SetAxiom forgets the key.
+  void SetCache(ExpansionCache* cache, uint64_t axiomKey);
 
-private:
-  void RenderStep(int index);
-  void DrawLine(float x1, float y1, float x2, float y2);
+  bool SaveScreenshot(const std::string& filename, int padding = 20);
 
-  SDL_Window* m_window;
+  // Starts capturing the current image; the PNG is encoded in the
+  // background once the pixels have arrived. FlushScreenshots waits until
+  // every queued capture has been written.
+  bool QueueScreenshot(const std::string& filename, int padding = 20);
+  void FlushScreenshots();
+
+  // Streams frames into one animation file instead of separate images: an
+  // animated PNG for a .png or .apng target, otherwise Y4M video (see
+  // VideoWriter). Captures go through the same readback as screenshots, and
+  // FlushScreenshots waits for them too.
+  bool OpenVideo(const std::string& target);
+  bool QueueVideoFrame(int padding = 20);
+  void CloseVideo();
+
+protected:
+  // Draws m_geometry.Segments[begin, end).
+  virtual void DrawSegments(size_t begin, size_t end) = 0;
+
+  // Draws every placement of m_instanced.
+  virtual void DrawInstances() {}
+
+  // Reads a w*h block of RGBA pixels, bottom row first, as glReadPixels does.
+  virtual bool ReadPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int* pixels) = 0;
+
+  // Backends that can overlap readback with rendering override these. The
+  // default reads synchronously and calls back straight away.
+  virtual bool ReadPixelsAsync(unsigned int x, unsigned int y, unsigned int w, unsigned int h, PixelCallback callback);
+  virtual void FlushReads() {}
+
+  void CaptureRegion(int padding, unsigned int& x, unsigned int& y, unsigned int& w, unsigned int& h) const;
+
+  void Interpret(const std::vector<Turtle::Checkpoint>* resume = NULL);
+
+  // Given record, notes checkpoints along a long axiom for a later walk of
+  // the same axiom from another origin, which given them as resume walks
+  // the pieces between them at once across m_pool.
+  bool Walk(const std::vector<LConstant>& axiom, uint64_t axiomKey, float x, float y, Geometry& geometry, Progress* progress, float scale = 1.0f,
+    std::vector<Turtle::Checkpoint>* record = NULL, const std::vector<Turtle::Checkpoint>* resume = NULL) const;
+  // Logs the size of the curve and the adjustment unless quiet, for work
+  // repeated per frame or variant, possibly on several threads at once.
+  void CenterOrigin(const Geometry& geometry, float& x, float& y, bool quiet = false) const;
+  Util::RGB SegmentColor(const Segment& segment) const;
 
   const ConfigurationType& m_config;
 
+  // Shared by walking, on whichever thread prepares geometry, and by any
+  // work the backend spreads across threads.
+  mutable ThreadPool m_pool;
+
   float m_lineWidth;
 
   float m_origX;
@@ -52,20 +182,29 @@ private:
   float m_minY;
   float m_maxX;
   float m_maxY;
-  float m_currRot;
-  float m_x;
-  float m_y;
 
   int m_windowWidth;
   int m_windowHeight;
 
+  View m_view;
+
   int m_drawIndex;
+  size_t m_progressiveDrawn;
 
   std::vector<LConstant>& m_axiom;
 
   Util::HSV m_color;
 
-  std::stack<RendererState> m_stateStack;
+  std::unique_ptr<FrameEncoder> m_encoder;
+  std::unique_ptr<FrameSink> m_video;
+
+  Geometry m_geometry;
+  InstancedGeometry m_instanced;
+  unsigned int m_geometryVersion;
+  bool m_interpreted;
+
+  ExpansionCache* m_cache;
+  uint64_t m_axiomKey;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,161 @@
+#ifndef _LEVEL_OF_DETAIL_H_
+#define _LEVEL_OF_DETAIL_H_
+
+#include "LSystem.h"
+#include "ConfigParser.h"
+#include "Progress.h"
+#include "Turtle.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// One placement of a mesh of InstancedGeometry.
+struct Instance
+{
+  float X;
+  float Y;
+  float Rotation;
+  float Scale;
+  unsigned int Mesh;
+
+  // Index of the subtree's first symbol, as for Segment::Index.
+  unsigned int Index;
+};
+
+struct InstancedGeometry
+{
+  // Each mesh is walked in segment lengths from the origin, with segment
+  // indices counted from its first symbol. A placement turns it by its
+  // rotation and scales it by Length times its scale.
+  std::vector<Geometry> Meshes;
+
+  // Grouped by mesh.
+  std::vector<Instance> Instances;
+
+  // Segment length in pixels, and the factor mesh indices are squeezed by
+  // to match Instance::Index.
+  float Length;
+  float IndexScale;
+
+  InstancedGeometry() : Length(1.0f), IndexScale(1.0f) {}
+};
+
+// Draws a deep generation of a deterministic system without expanding it.
+// Each symbol of the axiom is followed down through its successors depth
+// first, and once everything a symbol would expand to fits within a few
+// pixels it is drawn as one short stub from where it starts to where it
+// ends. What each (symbol, depth) pair does to the turtle and how far it
+// can reach is worked out once and shared by every occurrence.
+class LevelOfDetail
+{
+public:
+  LevelOfDetail(const LSystem& system, const GeneralConfigType& config);
+
+  // Furthest generation n can get from where it starts, in segment lengths.
+  // An upper bound: the drawn image is usually somewhat smaller.
+  float Reach(unsigned int n);
+
+  // Walks generation n from (x, y) with segments length pixels long,
+  // collapsing any subtree that cannot reach threshold pixels from where it
+  // starts, and skipping any that cannot reach into the rectangle given to
+  // Cull. Returns false if progress was cancelled part way.
+  bool Interpret(unsigned int n, float length, float threshold, float x, float y, Geometry& geometry, Progress* progress = NULL);
+
+  // Walks generation n from (x, y) in full detail, except that subtrees at
+  // one depth are each walked once into instanced.Meshes and otherwise only
+  // placed. The depth is chosen to keep the meshes and the placements about
+  // equally small. Whatever can't be placed, such as brackets that only
+  // pair up across subtrees, is walked into geometry as usual, and the
+  // bounds of geometry cover the placed subtrees too.
+  bool Instance(unsigned int n, float length, float x, float y, Geometry& geometry, InstancedGeometry& instanced, Progress* progress = NULL);
+
+  // Limits later walks to what is visible in the rectangle, in pixels.
+  void Cull(float minX, float minY, float maxX, float maxY);
+  void Uncull();
+
+private:
+  struct Pose
+  {
+    float X;
+    float Y;
+    float Rotation;
+  };
+
+  struct Summary
+  {
+    // False if the subtree pops state it didn't push or leaves state
+    // pushed, so that only walking it in full can follow it.
+    bool Balanced;
+    bool Draws;
+
+    // Where the subtree leaves the turtle, in the frame it starts in.
+    Pose End;
+
+    float Reach;
+    double Symbols;
+  };
+
+  struct Box
+  {
+    float MinX;
+    float MinY;
+    float MaxX;
+    float MaxY;
+  };
+
+  struct Walker
+  {
+    Turtle Pen;
+    Geometry& Output;
+    float Length;
+    float Limit;
+    double Done;
+    double Total;
+    double IndexScale;
+    size_t Steps;
+    Progress* Report;
+    bool Culling;
+
+    // Subtrees at InstanceDepth are placed into Instances rather than
+    // walked, unless Instances is null.
+    InstancedGeometry* Instances;
+    unsigned int InstanceDepth;
+    std::unordered_map<uint64_t, unsigned int> Meshes;
+
+    // Bounds of each mesh as turned by each rotation it is placed at.
+    std::unordered_map<uint64_t, Box> Turned;
+  };
+
+  // Sets up walker for generation n from (x, y), clearing geometry.
+  Walker Start(unsigned int n, float length, float threshold, float x, float y, Geometry& geometry, Progress* progress);
+  bool WalkAxiom(unsigned int n, Walker& walker);
+
+  // Places the subtree c expands to over depth more generations.
+  void Place(const LConstant& c, unsigned int depth, const Summary& summary, Walker& walker);
+  const Box& Turn(unsigned int mesh, float rotation, Walker& walker);
+
+  uint64_t Key(const LConstant& c, unsigned int depth) const;
+
+  const Summary& Summarize(const LConstant& c, unsigned int depth);
+
+  // Follows sequence expanded depth more times from pose, through the
+  // summaries where they can be used. Returns false on popping below the
+  // start of the sequence.
+  bool Fold(const std::vector<LConstant>& sequence, unsigned int depth, Pose& pose, std::vector<Pose>& stack, float& reach);
+
+  bool Walk(const LConstant& c, unsigned int depth, Walker& walker);
+
+  const LSystem& m_system;
+  const GeneralConfigType& m_config;
+
+  bool m_culling;
+  float m_cullMinX;
+  float m_cullMinY;
+  float m_cullMaxX;
+  float m_cullMaxY;
+
+  std::unordered_map<uint64_t, Summary> m_summaries;
+};
+
+#endif
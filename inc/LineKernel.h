@@ -0,0 +1,32 @@
+#ifndef _LINE_KERNEL_H_
+#define _LINE_KERNEL_H_
+
+// A thick line with round caps, prepared for coverage evaluation.
+struct CapsuleLine
+{
+  float AX;
+  float AY;
+  float DX;
+  float DY;
+  float InvLength2;
+  float Radius;
+
+  float Red;
+  float Green;
+  float Blue;
+
+  CapsuleLine(float x1, float y1, float x2, float y2, float width, unsigned int color);
+};
+
+namespace LineKernel
+{
+  // Blends the line into a run of count pixels of a planar float RGBA tile.
+  // The first pixel's centre is at (x, y); the rest follow at unit steps in x.
+  // Coverage is the capsule's signed distance, clamped to one pixel of ramp.
+  void BlendSpan(const CapsuleLine& line, float* red, float* green, float* blue, float* alpha, int count, float x, float y);
+
+  // Name of the instruction set BlendSpan dispatches to on this machine.
+  const char* InstructionSet();
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+// A file created at a fixed size and mapped for writing, so an image can be
+// produced straight into the page cache without a staging buffer, or an
+// existing file mapped for reading.
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  // Creates or truncates path, reserves size bytes on disk and maps them.
+  bool Create(const std::string& path, size_t size);
+
+  // Maps an existing file read-only.
+  bool Open(const std::string& path);
+
+  unsigned char* Data() const { return m_data; }
+  size_t Size() const { return m_size; }
+
+  // Unmaps the file, trimming it to size bytes if that is smaller than the
+  // size it was created with.
+  bool Close(size_t size);
+  bool Close() { return Close(m_size); }
+
+private:
+  unsigned char* m_data;
+  size_t m_size;
+
+#ifdef _WIN32
+  void* m_file;
+  void* m_mapping;
+#else
+  int m_fd;
+#endif
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _PIXEL_READBACK_H_
+#define _PIXEL_READBACK_H_
+
+#include <functional>
+#include <vector>
+
+// Called with a w*h block of RGBA pixels, bottom row first. The pointer is
+// only valid for the duration of the call.
+typedef std::function<void(const unsigned int* pixels, unsigned int w, unsigned int h)> PixelCallback;
+
+// Asynchronous glReadPixels through a ring of pixel buffer objects. Each
+// read is fenced, and its callback runs once the transfer has finished, so
+// the GPU can keep rendering the following frames in the meantime.
+// Callbacks run in the order the reads were queued.
+class PixelReadback
+{
+public:
+  PixelReadback(size_t ringSize = 3);
+  ~PixelReadback();
+
+  // Needs a current GL context with pixel buffer objects and sync objects.
+  static bool Supported();
+
+  // Returns false, without keeping callback, if the read couldn't start.
+  bool Queue(unsigned int x, unsigned int y, unsigned int w, unsigned int h, PixelCallback callback);
+
+  // Completes reads whose transfers are done. With wait, completes them all.
+  void Poll(bool wait);
+
+  // Reads completed without their pixels, whose callbacks never ran, since
+  // the last call.
+  size_t TakeFailures();
+
+private:
+  struct Slot
+  {
+    unsigned int Buffer;
+    size_t Capacity;
+    void* Fence;
+    unsigned int Width;
+    unsigned int Height;
+    PixelCallback Callback;
+  };
+
+  bool Ready(Slot& slot, bool wait);
+  void Complete(Slot& slot);
+
+  std::vector<Slot> m_slots;
+  size_t m_oldest;
+  size_t m_pending;
+  size_t m_failures;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _PROGRESS_H_
+#define _PROGRESS_H_
+
+#include <atomic>
+
+// Shared between long running work and whoever is waiting on it: the work
+// reports what it is doing and polls for cancellation, the waiting side
+// reads the report and may cancel.
+class Progress
+{
+public:
+  Progress()
+    : m_cancelled(false)
+    , m_stage("")
+    , m_fraction(0.0f)
+  {
+  }
+
+  void Reset()
+  {
+    m_cancelled = false;
+    m_stage = "";
+    m_fraction = 0.0f;
+  }
+
+  void Cancel() { m_cancelled = true; }
+  bool Cancelled() const { return m_cancelled; }
+
+  // stage must be a string literal; fraction runs from 0 to 1 per stage.
+  void Report(const char* stage, float fraction)
+  {
+    m_stage = stage;
+    m_fraction = fraction;
+  }
+
+  const char* Stage() const { return m_stage; }
+  float Fraction() const { return m_fraction; }
+
+private:
+  std::atomic<bool> m_cancelled;
+  std::atomic<const char*> m_stage;
+  std::atomic<float> m_fraction;
+};
+
+// How many symbols work goes between checking for cancellation and
+// reporting progress.
+#define PROGRESS_INTERVAL 65536
+
+#endif
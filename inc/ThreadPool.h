@@ -0,0 +1,41 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+  // A thread count of 0 uses one thread per hardware core.
+  ThreadPool(unsigned int threads = 0);
+  ~ThreadPool();
+
+  void Enqueue(std::function<void()> task);
+  void Wait();
+
+  // Runs fn(0..count-1) across the pool. The calling thread takes part, so
+  // this is safe to call from inside a pool task.
+  void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+  unsigned int Size() const;
+
+private:
+  void Worker();
+
+  std::vector<std::thread> m_threads;
+  std::queue<std::function<void()>> m_tasks;
+
+  std::mutex m_mutex;
+  std::condition_variable m_taskAvailable;
+  std::condition_variable m_tasksDone;
+
+  unsigned int m_active;
+  bool m_stopping;
+};
+
+#endif
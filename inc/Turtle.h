@@ -0,0 +1,98 @@
+#ifndef _TURTLE_H_
+#define _TURTLE_H_
+
+#include "LSystem.h"
+#include "ConfigParser.h"
+#include "Progress.h"
+
+#include <stack>
+#include <vector>
+
+#define PI 3.14159265358979323846
+
+struct RendererState
+{
+  float X;
+  float Y;
+  float Rotation;
+};
+
+struct Segment
+{
+  float X1;
+  float Y1;
+  float X2;
+  float Y2;
+  unsigned int Index;
+};
+
+struct Geometry
+{
+  std::vector<Segment> Segments;
+  size_t Symbols;
+
+  float MinX;
+  float MinY;
+  float MaxX;
+  float MaxY;
+
+  Geometry();
+};
+
+class Turtle
+{
+public:
+  // Where the turtle stood before symbol Symbol of an axiom, with whatever
+  // state was pushed by then, so that walking can resume from there.
+  struct Checkpoint
+  {
+    size_t Symbol;
+    RendererState State;
+    std::stack<RendererState> Stack;
+  };
+
+  // scale multiplies the configured segment length.
+  Turtle(const GeneralConfigType& config, float scale = 1.0f);
+  ~Turtle() {}
+
+  void Reset(float x, float y);
+  void Reset(float x, float y, float rotation);
+
+  // Walks the whole axiom from the current state, appending every drawn
+  // segment and growing the bounds by every position visited. Returns false
+  // if progress was cancelled part way.
+  bool Interpret(const std::vector<LConstant>& axiom, Geometry& geometry, Progress* progress = NULL);
+
+  // Walks only axiom[begin, end), indexing segments within the whole axiom.
+  // Given checkpoints, also records one before every interval-th symbol.
+  bool Interpret(const std::vector<LConstant>& axiom, size_t begin, size_t end, Geometry& geometry, Progress* progress = NULL,
+    std::vector<Checkpoint>* checkpoints = NULL, size_t interval = 0);
+
+  // Picks up from checkpoint, moved x, y pixels from where it was recorded.
+  void Restore(const Checkpoint& checkpoint, float x = 0.0f, float y = 0.0f);
+
+  // Applies one symbol. Returns true and fills segment if it drew a line.
+  bool Step(const LConstant& c, Segment& segment);
+
+  // Moves and turns as a whole run of symbols would have, given where that
+  // run ends up relative to where it starts: x and y in segment lengths
+  // along and across the current heading, rotation in degrees.
+  void Jump(float x, float y, float rotation);
+
+  float X() const { return m_x; }
+  float Y() const { return m_y; }
+  float Rotation() const { return m_currRot; }
+
+private:
+  float m_length;
+  float m_angle;
+  float m_startingRotation;
+
+  float m_x;
+  float m_y;
+  float m_currRot;
+
+  std::stack<RendererState> m_stateStack;
+};
+
+#endif
@@ -33,6 +33,16 @@ namespace Util
     RGB() : RGB(0.0,0.0,0.0)
     {
     }
+
+    bool operator==(const RGB& rgb) const
+    {
+      return Red == rgb.Red && Green == rgb.Green && Blue == rgb.Blue;
+    }
+
+    bool operator!=(const RGB& rgb) const
+    {
+      return !(*this == rgb);
+    }
   };
 
   std::vector<std::string> split(std::string input, const char delim);
@@ -0,0 +1,55 @@
+#ifndef _VIDEO_WRITER_H_
+#define _VIDEO_WRITER_H_
+
+#include "FrameSink.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Streams captured frames as YUV4MPEG2 (Y4M) video, either to a file or to
+// the stdin of an encoder process. Frames are converted to 4:2:0 YUV on the
+// submitting thread, straight from the readback buffer, and written in order
+// on a background thread. At most queueDepth frames wait to be written.
+class VideoWriter : public FrameSink
+{
+public:
+  VideoWriter(int framerate, size_t queueDepth = 4);
+  ~VideoWriter();
+
+  // target is a path to a .y4m file, or a command prefixed with '|' that
+  // reads Y4M on stdin, e.g. "|ffmpeg -i - -c:v libx264 out.mp4".
+  bool Open(const std::string& target) override;
+  void Close() override;
+
+  // The video size is the first frame's, rounded up to even.
+  void Submit(const unsigned int* pixels, unsigned int w, unsigned int h) override;
+  void Wait() override;
+
+private:
+  void WriteFrame(const std::vector<unsigned char>& frame);
+
+  int m_framerate;
+
+  FILE* m_file;
+  bool m_pipe;
+  std::atomic<bool> m_failed;
+
+  unsigned int m_width;
+  unsigned int m_height;
+
+  ThreadPool m_writer;
+  size_t m_queueDepth;
+  size_t m_inFlight;
+
+  std::vector<std::vector<unsigned char>> m_freeBuffers;
+
+  std::mutex m_mutex;
+  std::condition_variable m_slotFree;
+};
+
+#endif
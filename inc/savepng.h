@@ -29,6 +29,95 @@
  */
 int SDL_SavePNG_RW(SDL_Surface *surface, SDL_RWops *rw, int freedst);
 
+/*
+ * Row filters for SDL_SavePNGOptions. DEFAULT leaves the choice to libpng;
+ * ADAPTIVE tries every filter on each row and keeps the one with the
+ * smallest sum of absolute differences.
+ */
+enum
+{
+	SDL_SAVEPNG_FILTER_DEFAULT = 0,
+	SDL_SAVEPNG_FILTER_NONE,
+	SDL_SAVEPNG_FILTER_SUB,
+	SDL_SAVEPNG_FILTER_UP,
+	SDL_SAVEPNG_FILTER_AVERAGE,
+	SDL_SAVEPNG_FILTER_PAETH,
+	SDL_SAVEPNG_FILTER_ADAPTIVE
+};
+
+/*
+ * Colour reduction for SDL_SavePNGOptions, applied to 32-bit RGBA surfaces.
+ * LOSSLESS writes an indexed PNG (1, 2, 4 or 8 bits per pixel, with a tRNS
+ * chunk for translucent entries) when the image holds at most 256 distinct
+ * colours, and drops the alpha channel when every pixel is opaque.
+ * QUANTIZE additionally rounds the channels to fewer levels, as far as 16,
+ * until the colours fit in a palette.
+ */
+enum
+{
+	SDL_SAVEPNG_REDUCE_NONE = 0,
+	SDL_SAVEPNG_REDUCE_LOSSLESS,
+	SDL_SAVEPNG_REDUCE_QUANTIZE
+};
+
+/*
+ * Options for SDL_SavePNG_RW_Ex. Zero-initialise for the defaults.
+ *
+ * flip        - non-zero to write the surface's rows bottom-up, e.g. for
+ *               pixels straight from glReadPixels
+ * compression - zlib level 1-9, or 0 for the zlib default
+ * filter      - one of the SDL_SAVEPNG_FILTER_* values
+ * threads     - with more than one, large truecolor images are filtered
+ *               and deflated in independent row bands on that many
+ *               threads and stitched into a single IDAT stream
+ * reduce      - one of the SDL_SAVEPNG_REDUCE_* values
+ */
+typedef struct SDL_SavePNGOptions
+{
+	int flip;
+	int compression;
+	int filter;
+	int threads;
+	int reduce;
+} SDL_SavePNGOptions;
+
+/*
+ * Save an SDL_Surface as a PNG file, using writable RWops and options.
+ * options may be NULL for the defaults.
+ *
+ * Returns 0 success or -1 on failure, the error message is then retrievable
+ * via SDL_GetError().
+ */
+int SDL_SavePNG_RW_Ex(SDL_Surface *surface, SDL_RWops *rw, int freedst, const SDL_SavePNGOptions *options);
+
+/*
+ * Animated PNG (APNG) writer. Frames are RGBA regions of a width x height
+ * canvas, each replacing the pixels under it (APNG_BLEND_OP_SOURCE) and
+ * left in place for the next frame (APNG_DISPOSE_OP_NONE). The first frame
+ * must cover the whole canvas. The frame count is patched into the header
+ * when the animation ends, so dst must be seekable.
+ *
+ * options may be NULL; compression, filter and flip apply to every frame.
+ */
+typedef struct SDL_APNGWriter SDL_APNGWriter;
+
+SDL_APNGWriter *SDL_APNG_Begin(SDL_RWops *dst, int freedst, int width, int height, const SDL_SavePNGOptions *options);
+
+/*
+ * Append surface, a 32-bit RGBA region, at (x, y) on the canvas, shown for
+ * delay_num / delay_den seconds.
+ *
+ * Returns 0 success or -1 on failure.
+ */
+int SDL_APNG_WriteFrame(SDL_APNGWriter *writer, SDL_Surface *surface, int x, int y, Uint16 delay_num, Uint16 delay_den);
+
+/*
+ * Finish the file and free the writer.
+ *
+ * Returns 0 success or -1 on failure.
+ */
+int SDL_APNG_End(SDL_APNGWriter *writer);
+
 /*
  * Return new SDL_Surface with a format suitable for PNG output.
  */
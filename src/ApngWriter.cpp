@@ -0,0 +1,247 @@
+#include "ApngWriter.h"
+
+#include "SDL.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+ApngWriter::ApngWriter(int framerate, const SDL_SavePNGOptions& options, size_t queueDepth)
+  : m_framerate(framerate)
+  , m_options(options)
+  , m_file(NULL)
+  , m_writer(NULL)
+  , m_failed(false)
+  , m_width(0)
+  , m_height(0)
+  , m_pendingFrames(0)
+  , m_encoder(1)
+  , m_queueDepth(queueDepth)
+  , m_inFlight(0)
+{
+  // Frames are stored top row first.
+  m_options.flip = 0;
+}
+
+ApngWriter::~ApngWriter()
+{
+  Close();
+}
+
+bool ApngWriter::Open(const std::string& target)
+{
+  Close();
+
+  m_file = SDL_RWFromFile(target.c_str(), "wb");
+  if (m_file == NULL)
+  {
+    std::cerr << "Failed to open animated PNG \"" << target << "\": " << SDL_GetError() << std::endl;
+    return false;
+  }
+
+  std::cout << "Writing animated PNG to " << target << "." << std::endl;
+
+  m_failed = false;
+  m_width = 0;
+  m_height = 0;
+  return true;
+}
+
+void ApngWriter::Close()
+{
+  Wait();
+
+  if (m_writer != NULL)
+  {
+    if (!m_failed)
+    {
+      WritePending();
+    }
+
+    if (SDL_APNG_End(m_writer) != 0)
+    {
+      std::cerr << "Finishing animated PNG failed: " << SDL_GetError() << std::endl;
+    }
+  }
+  else if (m_file != NULL)
+  {
+    SDL_RWclose(m_file);
+  }
+
+  m_file = NULL;
+  m_writer = NULL;
+  m_previous.reset();
+  m_pendingFrames = 0;
+}
+
+void ApngWriter::Submit(const unsigned int* pixels, unsigned int w, unsigned int h)
+{
+  if (m_file == NULL || w == 0 || h == 0)
+  {
+    return;
+  }
+
+  Frame frame;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_slotFree.wait(lock, [this] { return m_inFlight < m_queueDepth; });
+    ++m_inFlight;
+
+    if (m_width == 0)
+    {
+      m_width = w;
+      m_height = h;
+    }
+
+    if (!m_freeBuffers.empty())
+    {
+      frame = std::move(m_freeBuffers.back());
+      m_freeBuffers.pop_back();
+    }
+  }
+
+  // Flip to top row first while copying, cropping or padding with
+  // transparent pixels to the canvas size.
+  frame.assign((size_t)m_width * m_height, 0);
+  unsigned int rows = std::min(h, m_height);
+  unsigned int columns = std::min(w, m_width);
+  for (unsigned int y = 0; y < rows; ++y)
+  {
+    memcpy(frame.data() + (size_t)y * m_width, pixels + (size_t)(h - 1 - y) * w, columns * sizeof(unsigned int));
+  }
+
+  auto shared = std::make_shared<Frame>(std::move(frame));
+  m_encoder.Enqueue([this, shared]()
+  {
+    Process(shared);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_inFlight;
+    }
+    m_slotFree.notify_one();
+  });
+}
+
+void ApngWriter::Wait()
+{
+  m_encoder.Wait();
+}
+
+void ApngWriter::Process(std::shared_ptr<Frame> frame)
+{
+  if (m_failed)
+  {
+    Recycle(frame);
+    return;
+  }
+
+  if (!m_previous)
+  {
+    m_writer = SDL_APNG_Begin(m_file, 1, m_width, m_height, &m_options);
+    if (m_writer == NULL)
+    {
+      std::cerr << "Starting animated PNG failed: " << SDL_GetError() << std::endl;
+      m_file = NULL;
+      m_failed = true;
+      Recycle(frame);
+      return;
+    }
+
+    m_previous = frame;
+    m_pending = { 0, 0, m_width, m_height };
+    m_pendingFrames = 1;
+    return;
+  }
+
+  Rect dirty;
+  if (!DirtyRect(*m_previous, *frame, dirty))
+  {
+    ++m_pendingFrames;
+    Recycle(frame);
+    return;
+  }
+
+  WritePending();
+  Recycle(m_previous);
+
+  m_previous = frame;
+  m_pending = dirty;
+  m_pendingFrames = 1;
+}
+
+bool ApngWriter::DirtyRect(const Frame& previous, const Frame& current, Rect& rect) const
+{
+  const unsigned int* a = previous.data();
+  const unsigned int* b = current.data();
+  size_t rowBytes = m_width * sizeof(unsigned int);
+
+  unsigned int top = 0;
+  while (top < m_height && memcmp(a + (size_t)top * m_width, b + (size_t)top * m_width, rowBytes) == 0)
+  {
+    ++top;
+  }
+
+  if (top == m_height)
+  {
+    return false;
+  }
+
+  unsigned int bottom = m_height;
+  while (memcmp(a + (size_t)(bottom - 1) * m_width, b + (size_t)(bottom - 1) * m_width, rowBytes) == 0)
+  {
+    --bottom;
+  }
+
+  // Columns only need scanning up to the edges found so far.
+  unsigned int left = m_width;
+  unsigned int right = 0;
+  for (unsigned int y = top; y < bottom; ++y)
+  {
+    const unsigned int* rowA = a + (size_t)y * m_width;
+    const unsigned int* rowB = b + (size_t)y * m_width;
+
+    unsigned int l = 0;
+    while (l < left && rowA[l] == rowB[l]) ++l;
+    left = l;
+
+    unsigned int r = m_width;
+    while (r > right && rowA[r - 1] == rowB[r - 1]) --r;
+    right = r;
+  }
+
+  rect = { left, top, right - left, bottom - top };
+  return true;
+}
+
+void ApngWriter::WritePending()
+{
+  if (!m_previous || m_pendingFrames == 0)
+  {
+    return;
+  }
+
+  SDL_Surface* region = SDL_CreateRGBSurfaceFrom(m_previous->data() + (size_t)m_pending.Y * m_width + m_pending.X,
+    m_pending.W, m_pending.H, 8*4, m_width*4, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
+  if (region == NULL)
+  {
+    std::cerr << "Creating surface failed: " << SDL_GetError() << std::endl;
+    m_failed = true;
+    return;
+  }
+
+  Uint16 delay = (Uint16)std::min(m_pendingFrames, 65535u);
+  if (SDL_APNG_WriteFrame(m_writer, region, m_pending.X, m_pending.Y, delay, (Uint16)m_framerate) != 0)
+  {
+    std::cerr << "Writing animated PNG frame failed: " << SDL_GetError() << std::endl;
+    m_failed = true;
+  }
+
+  SDL_FreeSurface(region);
+  m_pendingFrames = 0;
+}
+
+void ApngWriter::Recycle(std::shared_ptr<Frame> frame)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_freeBuffers.push_back(std::move(*frame));
+}
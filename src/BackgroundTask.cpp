@@ -0,0 +1,66 @@
+#include "BackgroundTask.h"
+
+BackgroundTask::BackgroundTask()
+  : m_running(false)
+  , m_uncollected(false)
+{
+}
+
+BackgroundTask::~BackgroundTask()
+{
+  Cancel();
+}
+
+void BackgroundTask::Start(std::function<void(Progress&)> work)
+{
+  Cancel();
+
+  m_progress.Reset();
+  m_running = true;
+  m_uncollected = true;
+  m_thread = std::thread([this, work]()
+  {
+    work(m_progress);
+    m_running = false;
+  });
+}
+
+void BackgroundTask::Cancel()
+{
+  if (m_thread.joinable())
+  {
+    m_progress.Cancel();
+    m_thread.join();
+  }
+
+  m_uncollected = false;
+}
+
+void BackgroundTask::Wait()
+{
+  if (m_thread.joinable())
+  {
+    m_thread.join();
+  }
+}
+
+bool BackgroundTask::Running() const
+{
+  return m_running;
+}
+
+bool BackgroundTask::Finished()
+{
+  if (m_running || !m_uncollected)
+  {
+    return false;
+  }
+
+  if (m_thread.joinable())
+  {
+    m_thread.join();
+  }
+
+  m_uncollected = false;
+  return !m_progress.Cancelled();
+}
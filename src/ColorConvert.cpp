@@ -0,0 +1,172 @@
+#include "ColorConvert.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define COLOR_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+static inline unsigned char Luma(unsigned int p)
+{
+  int r = p & 0xFF, g = (p >> 8) & 0xFF, b = (p >> 16) & 0xFF;
+  return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+// Chroma of a 2x2 block from the sums of its four pixels' channels.
+static inline unsigned char ChromaU(int r, int g, int b)
+{
+  return (unsigned char)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+}
+
+static inline unsigned char ChromaV(int r, int g, int b)
+{
+  return (unsigned char)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+}
+
+// Converts output columns [begin, end) of a pair of rows, begin even.
+static void ConvertRowsScalar(const unsigned int* row0, const unsigned int* row1, unsigned int srcW,
+                              unsigned int begin, unsigned int end,
+                              unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v)
+{
+  for (unsigned int x = begin; x < end; x += 2)
+  {
+    unsigned int xa = std::min(x, srcW - 1);
+    unsigned int xb = std::min(x + 1, srcW - 1);
+    unsigned int p[4] = { row0[xa], row0[xb], row1[xa], row1[xb] };
+
+    y0[x]     = Luma(p[0]);
+    y0[x + 1] = Luma(p[1]);
+    y1[x]     = Luma(p[2]);
+    y1[x + 1] = Luma(p[3]);
+
+    int r = 0, g = 0, b = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+      r += p[i] & 0xFF;
+      g += (p[i] >> 8) & 0xFF;
+      b += (p[i] >> 16) & 0xFF;
+    }
+    u[x / 2] = ChromaU(r, g, b);
+    v[x / 2] = ChromaV(r, g, b);
+  }
+}
+
+#ifdef COLOR_CONVERT_X86
+
+// Splits 8 RGBA pixels into 16-bit R, G and B lanes.
+static inline void Unpack(const unsigned int* p, __m128i& r, __m128i& g, __m128i& b)
+{
+  const __m128i mask = _mm_set1_epi32(0xFF);
+  __m128i lo = _mm_loadu_si128((const __m128i*)p);
+  __m128i hi = _mm_loadu_si128((const __m128i*)(p + 4));
+
+  r = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+  g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+  b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+}
+
+// The weighted sum stays below 2^16, so wrapping 16-bit arithmetic and a
+// logical shift give the exact scalar result.
+static inline __m128i Luma8(__m128i r, __m128i g, __m128i b)
+{
+  __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+  sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+  return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+static void ConvertRowsSSE2(const unsigned int* row0, const unsigned int* row1, unsigned int srcW,
+                            unsigned int begin, unsigned int end,
+                            unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v)
+{
+  const __m128i ones  = _mm_set1_epi16(1);
+  const __m128i uRG   = _mm_setr_epi16(-38, -74, -38, -74, -38, -74, -38, -74);
+  const __m128i uB    = _mm_setr_epi16(112, 512, 112, 512, 112, 512, 112, 512);
+  const __m128i vRG   = _mm_setr_epi16(112, -94, 112, -94, 112, -94, 112, -94);
+  const __m128i vB    = _mm_setr_epi16(-18, 512, -18, 512, -18, 512, -18, 512);
+  const __m128i bias  = _mm_set1_epi32(128);
+
+  unsigned int x = begin;
+  unsigned int simdEnd = std::min(end, srcW);
+  for (; x + 8 <= simdEnd; x += 8)
+  {
+    __m128i r0, g0, b0, r1, g1, b1;
+    Unpack(row0 + x, r0, g0, b0);
+    Unpack(row1 + x, r1, g1, b1);
+
+    __m128i luma0 = Luma8(r0, g0, b0);
+    __m128i luma1 = Luma8(r1, g1, b1);
+    _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(luma0, luma0));
+    _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(luma1, luma1));
+
+    // Sum each 2x2 block: rows first, then horizontal pairs into 32 bits.
+    __m128i sr = _mm_madd_epi16(_mm_add_epi16(r0, r1), ones);
+    __m128i sg = _mm_madd_epi16(_mm_add_epi16(g0, g1), ones);
+    __m128i sb = _mm_madd_epi16(_mm_add_epi16(b0, b1), ones);
+
+    // Interleave (r, g) and (b, 1) so madd applies the weights and the
+    // rounding term in one go.
+    __m128i rg = _mm_unpacklo_epi16(_mm_packs_epi32(sr, sr), _mm_packs_epi32(sg, sg));
+    __m128i bk = _mm_unpacklo_epi16(_mm_packs_epi32(sb, sb), ones);
+
+    __m128i cu = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rg, uRG), _mm_madd_epi16(bk, uB)), 10), bias);
+    __m128i cv = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rg, vRG), _mm_madd_epi16(bk, vB)), 10), bias);
+
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(cu, cv), _mm_setzero_si128());
+    int chroma[2] = { _mm_cvtsi128_si32(packed), _mm_cvtsi128_si32(_mm_srli_si128(packed, 4)) };
+    memcpy(u + x / 2, &chroma[0], 4);
+    memcpy(v + x / 2, &chroma[1], 4);
+  }
+
+  if (x < end)
+  {
+    ConvertRowsScalar(row0, row1, srcW, x, end, y0, y1, u, v);
+  }
+}
+
+#endif
+
+typedef void (*ConvertRowsFunction)(const unsigned int*, const unsigned int*, unsigned int, unsigned int, unsigned int,
+                                    unsigned char*, unsigned char*, unsigned char*, unsigned char*);
+
+struct ConverterChoice
+{
+  ConvertRowsFunction Function;
+  const char* Name;
+};
+
+static ConverterChoice ChooseConverter()
+{
+#ifdef COLOR_CONVERT_X86
+  return { ConvertRowsSSE2, "SSE2" };
+#else
+  return { ConvertRowsScalar, "scalar" };
+#endif
+}
+
+static const ConverterChoice s_converter = ChooseConverter();
+
+void ColorConvert::RGBAToI420(const unsigned int* pixels, unsigned int srcW, unsigned int srcH,
+                              unsigned int width, unsigned int height,
+                              unsigned char* y, unsigned char* u, unsigned char* v)
+{
+  unsigned int chromaWidth = width / 2;
+
+  for (unsigned int row = 0; row < height; row += 2)
+  {
+    // Output rows run top down; the source is bottom row first.
+    unsigned int top    = srcH - 1 - std::min(row, srcH - 1);
+    unsigned int bottom = srcH - 1 - std::min(row + 1, srcH - 1);
+
+    s_converter.Function(pixels + (size_t)top * srcW, pixels + (size_t)bottom * srcW, srcW, 0, width,
+                         y + (size_t)row * width, y + (size_t)(row + 1) * width,
+                         u + (size_t)(row / 2) * chromaWidth, v + (size_t)(row / 2) * chromaWidth);
+  }
+}
+
+const char* ColorConvert::InstructionSet()
+{
+  return s_converter.Name;
+}
@@ -1,14 +1,21 @@
 #include "ConfigParser.h"
 #include "Util.h"
 #include <iostream>
+#include <tuple>
 
 ConfigParser::ConfigParser(std::string filename, ConfigurationType& config)
 {
   INIReader ini(filename);
+  m_valid = (ini.ParseError() == 0);
+
   ParseWindowConfiguration(ini, config);
   ParseGeneralConfiguration(ini, config);
   ParseSystemConfiguration(ini, config);
   ParseRuleConfiguration(ini, config);
+  ParseOutputConfiguration(ini, config);
+  ParseCacheConfiguration(ini, config);
+  ParseSceneConfiguration(ini, config);
+  ParseSweepConfiguration(ini, config);
 }
 
 void ConfigParser::ParseWindowConfiguration(INIReader& ini, ConfigurationType& config)
@@ -17,6 +24,9 @@ void ConfigParser::ParseWindowConfiguration(INIReader& ini, ConfigurationType& c
   config.Window.Height    = ini.GetInteger("window", "height", 900);
   config.Window.Framerate = ini.GetInteger("window", "framerate", 60);
   config.Window.Display   = ini.GetBoolean("window", "display", true);
+  config.Window.Backend   = ini.Get("window", "backend", "gl");
+  config.Window.Threads   = ini.GetInteger("window", "threads", 0);
+  config.Window.Headless  = ini.GetBoolean("window", "headless", false);
 }
 
 void ConfigParser::ParseGeneralConfiguration(INIReader& ini, ConfigurationType& config)
@@ -29,12 +39,17 @@ void ConfigParser::ParseGeneralConfiguration(INIReader& ini, ConfigurationType&
   config.General.EndFrameTime     = ini.GetFloat("general", "endframetime", 2.5);
   config.General.StartingRotation = ini.GetFloat("general", "startingrotation", 0.0f);
   config.General.LineWidth        = ini.GetFloat("general", "linewidth", 1.0f);
+  config.General.Antialias        = ini.GetBoolean("general", "antialias", true);
   config.General.Center           = ini.GetBoolean("general", "center", true);
   config.General.FixedX           = ini.GetInteger("general", "fixedx", -1);
   config.General.FixedY           = ini.GetInteger("general", "fixedy", -1);
   config.General.Colorful         = ini.GetBoolean("general", "colorful", false);
   config.General.Saturation       = ini.GetFloat("general", "saturation", 0.6f);
   config.General.Padding          = ini.GetInteger("general", "padding", 20);
+  config.General.FrameBudget      = ini.GetFloat("general", "framebudget", 0.0f);
+  config.General.Preview          = ini.GetInteger("general", "preview", 0);
+  config.General.Lod              = ini.GetFloat("general", "lod", 0.0f);
+  config.General.Instancing       = ini.GetBoolean("general", "instancing", false);
 
   std::string color = ini.Get("general", "color", "1.0,1.0,1.0");
   config.General.Color = ParseColorString(color);
@@ -54,7 +69,9 @@ void ConfigParser::ParseSystemConfiguration(INIReader& ini, ConfigurationType& c
     config.System.Constants.push_back(std::make_pair(constants[i], action));
   }
 
-  config.System.Axiom = ini.Get("lsystem", "axiom", "");
+  config.System.Axiom           = ini.Get("lsystem", "axiom", "");
+  config.System.Seed            = ini.GetInteger("lsystem", "seed", 0);
+  config.System.KeepGenerations = ini.GetInteger("lsystem", "keepgenerations", 0);
 }
 
 void ConfigParser::ParseRuleConfiguration(INIReader& ini, ConfigurationType& config)
@@ -89,6 +106,89 @@ void ConfigParser::ParseRuleConfiguration(INIReader& ini, ConfigurationType& con
   }
 }
 
+void ConfigParser::ParseOutputConfiguration(INIReader& ini, ConfigurationType& config)
+{
+  config.Output.Encoders    = ini.GetInteger("output", "encoders", 0);
+  config.Output.Compression = ini.GetInteger("output", "compression", 0);
+  config.Output.Filter      = ini.Get("output", "filter", "default");
+  config.Output.PngThreads  = ini.GetInteger("output", "pngthreads", 0);
+  config.Output.Palette     = ini.Get("output", "palette", "auto");
+  config.Output.FrameFormat = ini.Get("output", "frameformat", "png");
+  config.Output.Mmap        = ini.GetBoolean("output", "mmap", false);
+}
+
+void ConfigParser::ParseCacheConfiguration(INIReader& ini, ConfigurationType& config)
+{
+  config.Cache.Directory = ini.Get("cache", "directory", "");
+  config.Cache.MaxSize   = ini.GetInteger("cache", "maxsize", 1024);
+}
+
+void ConfigParser::ParseSceneConfiguration(INIReader& ini, ConfigurationType& config)
+{
+  config.Scene.Count    = ini.GetInteger("scene", "count", 0);
+  config.Scene.Variants = ini.GetInteger("scene", "variants", 4);
+  config.Scene.Seed     = ini.GetInteger("scene", "seed", 0);
+  config.Scene.Width    = ini.GetInteger("scene", "width", config.Window.Width);
+  config.Scene.Depth    = ini.GetInteger("scene", "depth", 0);
+  config.Scene.MinScale = ini.GetFloat("scene", "minscale", 0.5f);
+  config.Scene.MaxScale = ini.GetFloat("scene", "maxscale", 1.0f);
+  config.Scene.Tilt     = ini.GetFloat("scene", "tilt", 0.0f);
+}
+
+void ConfigParser::ParseSweepConfiguration(INIReader& ini, ConfigurationType& config)
+{
+  config.Sweep.Parameter = ini.Get("sweep", "parameter", "angle");
+  config.Sweep.Start     = ini.GetFloat("sweep", "start", 0.0f);
+  config.Sweep.End       = ini.GetFloat("sweep", "end", 0.0f);
+  config.Sweep.Frames    = ini.GetInteger("sweep", "frames", 0);
+}
+
+ConfigChange ConfigParser::Compare(const ConfigurationType& before, const ConfigurationType& after, bool& restart)
+{
+  auto window = [](const WindowConfigType& w) { return std::tie(w.Display, w.Width, w.Height, w.Framerate, w.Backend, w.Threads, w.Headless); };
+  auto output = [](const OutputConfigType& o) { return std::tie(o.Encoders, o.Compression, o.Filter, o.PngThreads, o.Palette, o.FrameFormat, o.Mmap); };
+  auto cache  = [](const CacheConfigType& c) { return std::tie(c.Directory, c.MaxSize); };
+  auto scene  = [](const SceneConfigType& s) { return std::tie(s.Count, s.Variants, s.Seed, s.Width, s.Depth, s.MinScale, s.MaxScale, s.Tilt); };
+
+  restart = window(before.Window) != window(after.Window)
+    || output(before.Output) != output(after.Output)
+    || cache(before.Cache) != cache(after.Cache)
+    || before.General.Antialias != after.General.Antialias;
+
+  const SystemConfigType& a = before.System;
+  const SystemConfigType& b = after.System;
+  if (a.Constants != b.Constants || a.Axiom != b.Axiom || a.Seed != b.Seed || a.KeepGenerations != b.KeepGenerations || a.Rules != b.Rules)
+  {
+    return ConfigChange::System;
+  }
+
+  const GeneralConfigType& g = before.General;
+  const GeneralConfigType& h = after.General;
+  // Level of detail, instancing and scenes walk the system instead of
+  // expanding it, and only apply to still images.
+  bool placed = h.Instancing || after.Scene.Count > 0;
+  if (g.Generation != h.Generation || g.Lod != h.Lod || g.Instancing != h.Instancing || scene(before.Scene) != scene(after.Scene)
+    || ((h.Lod > 0.0f || placed) && g.Animate != h.Animate) || (placed && g.FrameBudget != h.FrameBudget))
+  {
+    return ConfigChange::Generation;
+  }
+
+  if (g.Length != h.Length || g.Angle != h.Angle || g.StartingRotation != h.StartingRotation
+    || g.Center != h.Center || g.FixedX != h.FixedX || g.FixedY != h.FixedY)
+  {
+    return ConfigChange::Reinterpret;
+  }
+
+  if (g.LineWidth != h.LineWidth || g.Animate != h.Animate || g.AnimateTime != h.AnimateTime || g.EndFrameTime != h.EndFrameTime
+    || g.Colorful != h.Colorful || g.Color != h.Color || g.Background != h.Background || g.Saturation != h.Saturation || g.Padding != h.Padding
+    || g.FrameBudget != h.FrameBudget || g.Preview != h.Preview)
+  {
+    return ConfigChange::Redraw;
+  }
+
+  return ConfigChange::None;
+}
+
 Util::RGB ConfigParser::ParseColorString(std::string color)
 {
   Util::RGB output(1.0,1.0,1.0);
@@ -0,0 +1,95 @@
+#include "ConfigWatcher.h"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define POLL_INTERVAL std::chrono::milliseconds(250)
+
+ConfigWatcher::ConfigWatcher(const std::string& path)
+  : m_path(path)
+  , m_lastPoll(std::chrono::steady_clock::now())
+  , m_inotify(-1)
+{
+  std::error_code error;
+  m_modified = std::filesystem::last_write_time(m_path, error);
+
+#ifdef __linux__
+  std::filesystem::path directory = m_path.has_parent_path() ? m_path.parent_path() : std::filesystem::path(".");
+
+  m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_inotify >= 0 && inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    close(m_inotify);
+    m_inotify = -1;
+  }
+
+  if (m_inotify < 0)
+  {
+    std::cout << "inotify is unavailable. Polling " << m_path.string() << " for changes instead." << std::endl;
+  }
+#endif
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+#ifdef __linux__
+  if (m_inotify >= 0)
+  {
+    close(m_inotify);
+  }
+#endif
+}
+
+bool ConfigWatcher::Changed()
+{
+#ifdef __linux__
+  if (m_inotify >= 0)
+  {
+    std::string name = m_path.filename().string();
+    bool changed = false;
+
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(m_inotify, buffer, sizeof(buffer))) > 0)
+    {
+      for (char* p = buffer; p < buffer + length; )
+      {
+        const struct inotify_event* event = (const struct inotify_event*)p;
+        if (event->len > 0 && name == event->name)
+        {
+          changed = true;
+        }
+        p += sizeof(struct inotify_event) + event->len;
+      }
+    }
+
+    return changed;
+  }
+#endif
+
+  auto now = std::chrono::steady_clock::now();
+  if (now - m_lastPoll < POLL_INTERVAL)
+  {
+    return false;
+  }
+
+  m_lastPoll = now;
+  return ModifiedTimeChanged();
+}
+
+bool ConfigWatcher::ModifiedTimeChanged()
+{
+  std::error_code error;
+  std::filesystem::file_time_type modified = std::filesystem::last_write_time(m_path, error);
+  if (error || modified == m_modified)
+  {
+    return false;
+  }
+
+  m_modified = modified;
+  return true;
+}
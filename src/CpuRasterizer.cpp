@@ -0,0 +1,261 @@
+#include "CpuRasterizer.h"
+#include "LineKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+CpuRasterizer::CpuRasterizer(int width, int height, ThreadPool* pool, bool antialias)
+  : m_width(width)
+  , m_height(height)
+  , m_tilesX((width + TileSize - 1) / TileSize)
+  , m_tilesY((height + TileSize - 1) / TileSize)
+  , m_pixels(width * height, 0)
+  , m_bins(m_tilesX * m_tilesY)
+  , m_pool(pool)
+  , m_antialias(antialias)
+{
+}
+
+unsigned int CpuRasterizer::PackColor(float r, float g, float b, float a)
+{
+  auto channel = [](float v) { return (unsigned int)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+
+  return channel(r) | (channel(g) << 8) | (channel(b) << 16) | (channel(a) << 24);
+}
+
+void CpuRasterizer::Clear(unsigned int color)
+{
+  std::fill(m_pixels.begin(), m_pixels.end(), color);
+}
+
+void CpuRasterizer::DrawLines(const std::vector<RasterLine>& lines, float lineWidth)
+{
+  for (auto& bin : m_bins)
+  {
+    bin.clear();
+  }
+
+  float reach = lineWidth / 2.0f + 1.5f;
+
+  for (unsigned int i = 0; i < lines.size(); ++i)
+  {
+    const RasterLine& l = lines[i];
+
+    int x0 = (int)std::floor((std::min(l.X1, l.X2) - reach) / TileSize);
+    int x1 = (int)std::floor((std::max(l.X1, l.X2) + reach) / TileSize);
+    int y0 = (int)std::floor((std::min(l.Y1, l.Y2) - reach) / TileSize);
+    int y1 = (int)std::floor((std::max(l.Y1, l.Y2) + reach) / TileSize);
+
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, m_tilesX - 1);
+    y1 = std::min(y1, m_tilesY - 1);
+
+    for (int ty = y0; ty <= y1; ++ty)
+    {
+      for (int tx = x0; tx <= x1; ++tx)
+      {
+        m_bins[ty * m_tilesX + tx].push_back(i);
+      }
+    }
+  }
+
+  std::vector<size_t> busy;
+  for (size_t t = 0; t < m_bins.size(); ++t)
+  {
+    if (!m_bins[t].empty())
+    {
+      busy.push_back(t);
+    }
+  }
+
+  auto work = [&](size_t i)
+  {
+    if (m_antialias)
+      RasterizeTileAntialiased(busy[i], lines, lineWidth);
+    else
+      RasterizeTile(busy[i], lines, lineWidth);
+  };
+  if (m_pool)
+  {
+    m_pool->ParallelFor(busy.size(), work);
+  }
+  else
+  {
+    for (size_t i = 0; i < busy.size(); ++i)
+    {
+      work(i);
+    }
+  }
+}
+
+void CpuRasterizer::RasterizeTile(size_t tile, const std::vector<RasterLine>& lines, float lineWidth)
+{
+  int tileX0 = (tile % m_tilesX) * TileSize;
+  int tileY0 = (tile / m_tilesX) * TileSize;
+  int tileX1 = std::min(tileX0 + TileSize, m_width);
+  int tileY1 = std::min(tileY0 + TileSize, m_height);
+
+  float half = lineWidth / 2.0f;
+
+  for (unsigned int index : m_bins[tile])
+  {
+    const RasterLine& l = lines[index];
+
+    // Same vertex placement as the GL path: integer vertices nudged by the
+    // 0.375 projection offset.
+    float ax = (int)l.X1 + 0.375f;
+    float ay = (int)l.Y1 + 0.375f;
+    float bx = (int)l.X2 + 0.375f;
+    float by = (int)l.Y2 + 0.375f;
+
+    float dx = bx - ax;
+    float dy = by - ay;
+    float len2 = dx * dx + dy * dy;
+    float major = std::max(std::fabs(dx), std::fabs(dy));
+
+    int x0 = std::max((int)std::floor(std::min(ax, bx) - half - 1.0f), tileX0);
+    int x1 = std::min((int)std::ceil(std::max(ax, bx) + half + 1.0f), tileX1);
+    int y0 = std::max((int)std::floor(std::min(ay, by) - half - 1.0f), tileY0);
+    int y1 = std::min((int)std::ceil(std::max(ay, by) + half + 1.0f), tileY1);
+
+    for (int py = y0; py < y1; ++py)
+    {
+      unsigned int* row = &m_pixels[py * m_width];
+      float cy = py + 0.5f;
+
+      for (int px = x0; px < x1; ++px)
+      {
+        float cx = px + 0.5f;
+
+        // Aliased wide lines extend lineWidth pixels along the minor axis,
+        // and the GL_POINTS caps are lineWidth-sized squares.
+        bool covered = (std::fabs(cx - ax) < half && std::fabs(cy - ay) < half)
+                    || (std::fabs(cx - bx) < half && std::fabs(cy - by) < half);
+
+        if (!covered && len2 > 0.0f)
+        {
+          float t = ((cx - ax) * dx + (cy - ay) * dy) / len2;
+          float cross = (cx - ax) * dy - (cy - ay) * dx;
+          covered = (t >= 0.0f && t <= 1.0f && std::fabs(cross) / major < half);
+        }
+
+        if (covered)
+        {
+          row[px] = l.Color;
+        }
+      }
+    }
+  }
+}
+
+void CpuRasterizer::RasterizeTileAntialiased(size_t tile, const std::vector<RasterLine>& lines, float lineWidth)
+{
+  const int tileArea = TileSize * TileSize;
+  static thread_local std::vector<float> accumulation(4 * tileArea);
+
+  float* red   = accumulation.data();
+  float* green = red + tileArea;
+  float* blue  = green + tileArea;
+  float* alpha = blue + tileArea;
+
+  int tileX0 = (tile % m_tilesX) * TileSize;
+  int tileY0 = (tile / m_tilesX) * TileSize;
+  int tileX1 = std::min(tileX0 + TileSize, m_width);
+  int tileY1 = std::min(tileY0 + TileSize, m_height);
+
+  for (int py = tileY0; py < tileY1; ++py)
+  {
+    const unsigned int* src = &m_pixels[py * m_width];
+    int row = (py - tileY0) * TileSize - tileX0;
+    for (int px = tileX0; px < tileX1; ++px)
+    {
+      unsigned int c = src[px];
+      red[row + px]   = (c & 0xFF) / 255.0f;
+      green[row + px] = ((c >> 8) & 0xFF) / 255.0f;
+      blue[row + px]  = ((c >> 16) & 0xFF) / 255.0f;
+      alpha[row + px] = (c >> 24) / 255.0f;
+    }
+  }
+
+  float reach = lineWidth / 2.0f + 1.0f;
+
+  for (unsigned int index : m_bins[tile])
+  {
+    const RasterLine& l = lines[index];
+
+    // Integer turtle coordinates land on pixel centres.
+    CapsuleLine capsule(l.X1 + 0.5f, l.Y1 + 0.5f, l.X2 + 0.5f, l.Y2 + 0.5f, lineWidth, l.Color);
+
+    int y0 = std::max((int)std::floor(std::min(capsule.AY, capsule.AY + capsule.DY) - reach), tileY0);
+    int y1 = std::min((int)std::ceil(std::max(capsule.AY, capsule.AY + capsule.DY) + reach), tileY1);
+
+    for (int py = y0; py < y1; ++py)
+    {
+      float cy = py + 0.5f;
+
+      // Only the part of the segment within reach of this row matters.
+      float t0 = 0.0f;
+      float t1 = 1.0f;
+      if (std::fabs(capsule.DY) > 1e-6f)
+      {
+        t0 = (cy - reach - capsule.AY) / capsule.DY;
+        t1 = (cy + reach - capsule.AY) / capsule.DY;
+        if (t0 > t1) std::swap(t0, t1);
+        t0 = std::max(t0, 0.0f);
+        t1 = std::min(t1, 1.0f);
+      }
+
+      float xa = capsule.AX + t0 * capsule.DX;
+      float xb = capsule.AX + t1 * capsule.DX;
+
+      int x0 = std::max((int)std::floor(std::min(xa, xb) - reach), tileX0);
+      int x1 = std::min((int)std::ceil(std::max(xa, xb) + reach), tileX1);
+      if (x0 >= x1)
+      {
+        continue;
+      }
+
+      int offset = (py - tileY0) * TileSize + (x0 - tileX0);
+      LineKernel::BlendSpan(capsule, red + offset, green + offset, blue + offset, alpha + offset, x1 - x0, x0 + 0.5f, cy);
+    }
+  }
+
+  for (int py = tileY0; py < tileY1; ++py)
+  {
+    unsigned int* dst = &m_pixels[py * m_width];
+    int row = (py - tileY0) * TileSize - tileX0;
+    for (int px = tileX0; px < tileX1; ++px)
+    {
+      dst[px] = PackColor(red[row + px], green[row + px], blue[row + px], alpha[row + px]);
+    }
+  }
+}
+
+void CpuRasterizer::ReadPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int* pixels) const
+{
+  // Like glReadPixels, the origin may lie outside the buffer; anything not
+  // covered by the buffer reads back as zero.
+  int left = (int)x;
+  int bottom = (int)y;
+
+  int x0 = std::max(left, 0);
+  int x1 = std::min(left + (int)w, m_width);
+
+  for (unsigned int row = 0; row < h; ++row)
+  {
+    unsigned int* out = pixels + row * w;
+    int sy = bottom + (int)row;
+
+    if (sy < 0 || sy >= m_height || x0 >= x1)
+    {
+      std::fill(out, out + w, 0u);
+      continue;
+    }
+
+    std::fill(out, out + (x0 - left), 0u);
+    memcpy(out + (x0 - left), &m_pixels[sy * m_width + x0], (x1 - x0) * sizeof(unsigned int));
+    std::fill(out + (x1 - left), out + w, 0u);
+  }
+}
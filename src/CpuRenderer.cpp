@@ -0,0 +1,116 @@
+#include "CpuRenderer.h"
+#include "LineKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Placed segments rasterized at a time, which bounds the memory a large
+// scene takes while drawing.
+#define INSTANCE_BATCH 1048576
+
+CpuRenderer::CpuRenderer(std::vector<LConstant>& axiom, const ConfigurationType& config)
+  : LSystemRenderer(config.Window.Width, config.Window.Height, axiom, config)
+  , m_rasterizer(config.Window.Width, config.Window.Height, &m_pool, config.General.Antialias)
+  , m_drawnVersion(0)
+  , m_drawnSegments(0)
+  , m_instancesDrawn(false)
+  , m_clearPending(true)
+{
+  std::cout << "Rendering on the CPU with " << m_pool.Size() << " threads";
+  if (config.General.Antialias) std::cout << " using the " << LineKernel::InstructionSet() << " antialiased line kernel";
+  std::cout << "." << std::endl;
+}
+
+CpuRenderer::~CpuRenderer()
+{
+}
+
+void CpuRenderer::Setup(bool toScreen)
+{
+  Clear();
+}
+
+void CpuRenderer::Clear()
+{
+  m_clearPending = true;
+}
+
+void CpuRenderer::DrawSegments(size_t begin, size_t end)
+{
+  if (m_clearPending)
+  {
+    if (begin == 0 && m_geometryVersion == m_drawnVersion && end >= m_drawnSegments)
+    {
+      begin = m_drawnSegments;
+    }
+    else
+    {
+      const Util::RGB& bg = m_config.General.Background;
+      m_rasterizer.Clear(CpuRasterizer::PackColor(bg.Red, bg.Green, bg.Blue, 1.0f));
+      m_drawnSegments = 0;
+      m_instancesDrawn = false;
+    }
+
+    m_clearPending = false;
+  }
+
+  m_lines.clear();
+  for (size_t i = begin; i < end; ++i)
+  {
+    const Segment& s = m_geometry.Segments[i];
+    Util::RGB rgb = SegmentColor(s);
+    m_lines.push_back({ s.X1, s.Y1, s.X2, s.Y2, CpuRasterizer::PackColor(rgb.Red, rgb.Green, rgb.Blue, 1.0f) });
+  }
+
+  m_rasterizer.DrawLines(m_lines, m_lineWidth);
+
+  m_drawnVersion = m_geometryVersion;
+  m_drawnSegments = std::max(m_drawnSegments, end);
+}
+
+void CpuRenderer::DrawInstances()
+{
+  // Instances are drawn whole after the segments, so they only need drawing
+  // again once the segments have been cleared.
+  if (m_instancesDrawn)
+  {
+    return;
+  }
+
+  m_lines.clear();
+  for (const Instance& instance : m_instanced.Instances)
+  {
+    float length = m_instanced.Length * instance.Scale;
+    float cosine = cosf(instance.Rotation * PI / 180.0f) * length;
+    float sine = sinf(instance.Rotation * PI / 180.0f) * length;
+
+    for (const Segment& s : m_instanced.Meshes[instance.Mesh].Segments)
+    {
+      Segment placed;
+      placed.X1 = instance.X + s.X1 * cosine - s.Y1 * sine;
+      placed.Y1 = instance.Y + s.X1 * sine + s.Y1 * cosine;
+      placed.X2 = instance.X + s.X2 * cosine - s.Y2 * sine;
+      placed.Y2 = instance.Y + s.X2 * sine + s.Y2 * cosine;
+      placed.Index = instance.Index + (unsigned int)(s.Index * m_instanced.IndexScale);
+
+      Util::RGB rgb = SegmentColor(placed);
+      m_lines.push_back({ placed.X1, placed.Y1, placed.X2, placed.Y2, CpuRasterizer::PackColor(rgb.Red, rgb.Green, rgb.Blue, 1.0f) });
+    }
+
+    if (m_lines.size() >= INSTANCE_BATCH)
+    {
+      m_rasterizer.DrawLines(m_lines, m_lineWidth);
+      m_lines.clear();
+    }
+  }
+
+  m_rasterizer.DrawLines(m_lines, m_lineWidth);
+  m_instancesDrawn = true;
+}
+
+bool CpuRenderer::ReadPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int* pixels)
+{
+  m_rasterizer.ReadPixels(x, y, w, h, pixels);
+  return true;
+}
@@ -0,0 +1,382 @@
+#include "ExpansionCache.h"
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#define CACHE_VERSION 2
+
+struct CacheHeader
+{
+  char Magic[4];
+  uint32_t Version;
+  uint64_t Key;
+  uint64_t Count;
+};
+
+struct GeometryHeader
+{
+  CacheHeader Cache;
+  float MinX;
+  float MinY;
+  float MaxX;
+  float MaxY;
+  uint64_t Symbols;
+};
+
+// 64-bit FNV-1a
+class Hasher
+{
+public:
+  Hasher() : m_hash(14695981039346656037ull) {}
+
+  void Add(const void* data, size_t size)
+  {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+      m_hash = (m_hash ^ bytes[i]) * 1099511628211ull;
+    }
+  }
+
+  void Add(const std::string& s)
+  {
+    uint64_t size = s.size();
+    Add(&size, sizeof(size));
+    Add(s.data(), s.size());
+  }
+
+  template <typename T>
+  void AddValue(T value)
+  {
+    Add(&value, sizeof(value));
+  }
+
+  uint64_t Value() const
+  {
+    // 0 is reserved for "not cacheable".
+    return m_hash ? m_hash : 1;
+  }
+
+private:
+  uint64_t m_hash;
+};
+
+ExpansionCache::ExpansionCache(const CacheConfigType& config)
+  : m_directory(config.Directory)
+  , m_maxBytes((uint64_t)std::max(config.MaxSize, 0) * 1024 * 1024)
+  , m_bytes(0)
+{
+  if (!m_directory.empty())
+  {
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (error)
+    {
+      std::cerr << "Failed to create cache directory " << m_directory << ": " << error.message() << std::endl;
+      m_directory.clear();
+    }
+  }
+
+  if (Enabled())
+  {
+    Evict();
+  }
+}
+
+bool ExpansionCache::Enabled() const
+{
+  return !m_directory.empty();
+}
+
+uint64_t ExpansionCache::AxiomKey(const SystemConfigType& system, unsigned int generation)
+{
+  if (system.Seed == 0)
+  {
+    for (auto& rules : system.Rules)
+    {
+      if (rules.second.size() != 1 || rules.second[0].first < 1.0f)
+      {
+        return 0;
+      }
+    }
+  }
+
+  Hasher hash;
+  hash.AddValue<uint32_t>(CACHE_VERSION);
+
+  for (auto& constant : system.Constants)
+  {
+    hash.AddValue(constant.first);
+    hash.Add(constant.second);
+  }
+
+  hash.Add(system.Axiom);
+
+  for (auto& rules : system.Rules)
+  {
+    hash.AddValue(rules.first);
+    for (auto& rule : rules.second)
+    {
+      hash.AddValue(rule.first);
+      hash.Add(rule.second);
+    }
+  }
+
+  hash.AddValue(system.Seed);
+  hash.AddValue(generation);
+  return hash.Value();
+}
+
+uint64_t ExpansionCache::GeometryKey(uint64_t axiomKey, const GeneralConfigType& general, float originX, float originY)
+{
+  Hasher hash;
+  hash.AddValue(axiomKey);
+  hash.AddValue(general.Length);
+  hash.AddValue(general.Angle);
+  hash.AddValue(general.StartingRotation);
+  hash.AddValue(originX);
+  hash.AddValue(originY);
+  return hash.Value();
+}
+
+std::string ExpansionCache::Path(uint64_t key, const char* extension) const
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+  return (std::filesystem::path(m_directory) / (std::string(name) + extension)).string();
+}
+
+static bool ValidHeader(const MappedFile& file, const char* magic, uint64_t key, size_t headerSize, size_t elementSize)
+{
+  if (file.Size() < headerSize)
+  {
+    return false;
+  }
+
+  const CacheHeader* header = (const CacheHeader*)file.Data();
+  return memcmp(header->Magic, magic, 4) == 0
+    && header->Version == CACHE_VERSION
+    && header->Key == key
+    && file.Size() == headerSize + header->Count * elementSize;
+}
+
+bool ExpansionCache::LoadAxiom(uint64_t key, const std::vector<LConstant>& constants, std::vector<LConstant>& axiom)
+{
+  if (!Enabled() || key == 0)
+  {
+    return false;
+  }
+
+  std::string path = Path(key, ".axiom");
+  MappedFile file;
+  if (!file.Open(path) || !ValidHeader(file, "LSAX", key, sizeof(CacheHeader), 1))
+  {
+    return false;
+  }
+
+  int lookup[256];
+  std::fill(lookup, lookup + 256, -1);
+  for (size_t i = 0; i < constants.size(); ++i)
+  {
+    lookup[(unsigned char)constants[i].Name] = i;
+  }
+
+  uint64_t count = ((const CacheHeader*)file.Data())->Count;
+  const unsigned char* names = file.Data() + sizeof(CacheHeader);
+
+  std::vector<LConstant> loaded;
+  loaded.reserve(count);
+  for (uint64_t i = 0; i < count; ++i)
+  {
+    int index = lookup[names[i]];
+    if (index < 0)
+    {
+      return false;
+    }
+    loaded.push_back(constants[index]);
+  }
+
+  axiom = std::move(loaded);
+  file.Close();
+  Touch(path);
+  return true;
+}
+
+void ExpansionCache::StoreAxiom(uint64_t key, const std::vector<LConstant>& axiom)
+{
+  if (!Enabled() || key == 0)
+  {
+    return;
+  }
+
+  CacheHeader header = { { 'L', 'S', 'A', 'X' }, CACHE_VERSION, key, axiom.size() };
+
+  std::vector<char> names(axiom.size());
+  for (size_t i = 0; i < axiom.size(); ++i)
+  {
+    names[i] = axiom[i].Name;
+  }
+
+  if (Write(Path(key, ".axiom"), &header, sizeof(header), names.data(), names.size()) && m_bytes > m_maxBytes)
+  {
+    Evict();
+  }
+}
+
+bool ExpansionCache::LoadGeometry(uint64_t key, Geometry& geometry)
+{
+  if (!Enabled() || key == 0)
+  {
+    return false;
+  }
+
+  std::string path = Path(key, ".geometry");
+  MappedFile file;
+  if (!file.Open(path) || !ValidHeader(file, "LSGM", key, sizeof(GeometryHeader), sizeof(Segment)))
+  {
+    return false;
+  }
+
+  const GeometryHeader* header = (const GeometryHeader*)file.Data();
+  const Segment* segments = (const Segment*)(file.Data() + sizeof(GeometryHeader));
+
+  geometry.Segments.assign(segments, segments + header->Cache.Count);
+  geometry.Symbols = header->Symbols;
+  geometry.MinX = header->MinX;
+  geometry.MinY = header->MinY;
+  geometry.MaxX = header->MaxX;
+  geometry.MaxY = header->MaxY;
+
+  file.Close();
+  Touch(path);
+  return true;
+}
+
+void ExpansionCache::StoreGeometry(uint64_t key, const Geometry& geometry)
+{
+  if (!Enabled() || key == 0)
+  {
+    return;
+  }
+
+  GeometryHeader header = { { { 'L', 'S', 'G', 'M' }, CACHE_VERSION, key, geometry.Segments.size() },
+    geometry.MinX, geometry.MinY, geometry.MaxX, geometry.MaxY, geometry.Symbols };
+
+  if (Write(Path(key, ".geometry"), &header, sizeof(header), geometry.Segments.data(), geometry.Segments.size() * sizeof(Segment)) && m_bytes > m_maxBytes)
+  {
+    Evict();
+  }
+}
+
+bool ExpansionCache::Write(const std::string& path, const void* header, size_t headerSize, const void* data, size_t dataSize)
+{
+  // Write under a name private to this process and thread and rename into
+  // place, so a concurrent run never maps a half-written file.
+  std::string temporary = path + "." + std::to_string(getpid()) + "."
+    + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  bool success = fwrite(header, 1, headerSize, file) == headerSize
+    && (dataSize == 0 || fwrite(data, 1, dataSize, file) == dataSize);
+  success = (fclose(file) == 0) && success;
+
+  std::error_code error;
+  if (success)
+  {
+    uint64_t replaced = std::filesystem::file_size(path, error);
+    if (error) replaced = 0;
+
+    std::filesystem::rename(temporary, path, error);
+    success = !error;
+    if (success)
+    {
+      m_bytes += headerSize + dataSize;
+      m_bytes -= std::min<uint64_t>(replaced, m_bytes);
+    }
+  }
+
+  if (!success)
+  {
+    std::cerr << "Failed to write cache file " << path << "." << std::endl;
+    std::filesystem::remove(temporary, error);
+  }
+
+  return success;
+}
+
+void ExpansionCache::Touch(const std::string& path)
+{
+  std::error_code error;
+  std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+}
+
+void ExpansionCache::Evict()
+{
+  struct Entry
+  {
+    std::filesystem::path Path;
+    std::filesystem::file_time_type Used;
+    uint64_t Size;
+  };
+
+  std::error_code error;
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+
+  for (auto& item : std::filesystem::directory_iterator(m_directory, error))
+  {
+    std::string extension = item.path().extension().string();
+    if (extension != ".axiom" && extension != ".geometry")
+    {
+      continue;
+    }
+
+    Entry entry = { item.path(), item.last_write_time(error), item.file_size(error) };
+    if (!error)
+    {
+      entries.push_back(entry);
+      total += entry.Size;
+    }
+  }
+
+  m_bytes = total;
+  if (total <= m_maxBytes)
+  {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.Used < b.Used; });
+
+  for (auto& entry : entries)
+  {
+    if (total <= m_maxBytes)
+    {
+      break;
+    }
+
+    if (std::filesystem::remove(entry.Path, error))
+    {
+      total -= entry.Size;
+    }
+  }
+
+  m_bytes = total;
+}
@@ -0,0 +1,173 @@
+#include "FrameEncoder.h"
+
+#include "SDL.h"
+#include "savepng.h"
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+FrameEncoder::FrameEncoder(const OutputConfigType& config, size_t queueDepth)
+  : m_options(PNGOptions(config))
+  , m_mapped(config.Mmap)
+  , m_autoThreads(config.PngThreads == 0)
+  , m_pool(config.Encoders)
+  , m_queueDepth(queueDepth ? queueDepth : 2 * m_pool.Size())
+  , m_inFlight(0)
+{
+}
+
+FrameEncoder::~FrameEncoder()
+{
+  Wait();
+}
+
+void FrameEncoder::Submit(const std::string& filepath, const unsigned int* pixels, unsigned int w, unsigned int h)
+{
+  ImageWriter::Format format = ImageWriter::FromPath(filepath);
+  if (ImageWriter::IsUncompressed(format))
+  {
+    Write(filepath, format, pixels, w, h, m_options, m_mapped);
+    return;
+  }
+
+  size_t size = (size_t)w * h;
+
+  SDL_SavePNGOptions options = m_options;
+
+  std::vector<unsigned int> buffer;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_slotFree.wait(lock, [this] { return m_inFlight < m_queueDepth; });
+
+    // A lone screenshot deflates in bands across every core; frames of a
+    // sequence are already encoded side by side, one per encoder.
+    if (m_autoThreads && m_inFlight > 0)
+    {
+      options.threads = 1;
+    }
+    ++m_inFlight;
+
+    buffer = AcquireBuffer(size);
+  }
+
+  memcpy(buffer.data(), pixels, size * sizeof(unsigned int));
+
+  auto frame = std::make_shared<std::vector<unsigned int>>(std::move(buffer));
+  m_pool.Enqueue([this, filepath, format, frame, w, h, options]()
+  {
+    Write(filepath, format, frame->data(), w, h, options, m_mapped);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ReleaseBuffer(std::move(*frame));
+      --m_inFlight;
+    }
+    m_slotFree.notify_one();
+  });
+}
+
+void FrameEncoder::Wait()
+{
+  m_pool.Wait();
+}
+
+std::vector<unsigned int> FrameEncoder::AcquireBuffer(size_t size)
+{
+  for (auto iter = m_freeBuffers.begin(); iter != m_freeBuffers.end(); ++iter)
+  {
+    if (iter->capacity() >= size)
+    {
+      std::vector<unsigned int> buffer = std::move(*iter);
+      m_freeBuffers.erase(iter);
+      buffer.resize(size);
+      return buffer;
+    }
+  }
+
+  return std::vector<unsigned int>(size);
+}
+
+void FrameEncoder::ReleaseBuffer(std::vector<unsigned int>&& buffer)
+{
+  m_freeBuffers.push_back(std::move(buffer));
+}
+
+SDL_SavePNGOptions FrameEncoder::PNGOptions(const OutputConfigType& config)
+{
+  SDL_SavePNGOptions options = { 0 };
+  options.compression = config.Compression;
+  options.threads = config.PngThreads ? config.PngThreads : std::thread::hardware_concurrency();
+
+  if (config.Filter == "none")
+    options.filter = SDL_SAVEPNG_FILTER_NONE;
+  else if (config.Filter == "sub")
+    options.filter = SDL_SAVEPNG_FILTER_SUB;
+  else if (config.Filter == "up")
+    options.filter = SDL_SAVEPNG_FILTER_UP;
+  else if (config.Filter == "average")
+    options.filter = SDL_SAVEPNG_FILTER_AVERAGE;
+  else if (config.Filter == "paeth")
+    options.filter = SDL_SAVEPNG_FILTER_PAETH;
+  else if (config.Filter == "adaptive")
+    options.filter = SDL_SAVEPNG_FILTER_ADAPTIVE;
+  else
+    options.filter = SDL_SAVEPNG_FILTER_DEFAULT;
+
+  if (config.Palette == "off")
+    options.reduce = SDL_SAVEPNG_REDUCE_NONE;
+  else if (config.Palette == "quantize")
+    options.reduce = SDL_SAVEPNG_REDUCE_QUANTIZE;
+  else
+    options.reduce = SDL_SAVEPNG_REDUCE_LOSSLESS;
+
+  return options;
+}
+
+bool FrameEncoder::Write(const std::string& filepath, ImageWriter::Format format, const unsigned int* pixels, unsigned int w, unsigned int h, const SDL_SavePNGOptions& options, bool mapped)
+{
+  bool success;
+  switch (format)
+  {
+    case ImageWriter::Format::PNG:
+      return WritePNG(filepath, pixels, w, h, options);
+    case ImageWriter::Format::QOI:
+      success = ImageWriter::WriteQOI(filepath, pixels, w, h, mapped);
+      break;
+    default:
+      success = ImageWriter::WriteUncompressed(filepath, format, pixels, w, h, mapped);
+      break;
+  }
+
+  if (!success)
+  {
+    std::cerr << "Saving " << filepath << " failed." << std::endl;
+  }
+
+  return success;
+}
+
+bool FrameEncoder::WritePNG(const std::string& filepath, const unsigned int* pixels, unsigned int w, unsigned int h, const SDL_SavePNGOptions& options)
+{
+  SDL_Surface* sshot = SDL_CreateRGBSurfaceFrom((void*)pixels, w, h, 8*4, w*4, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
+  if (sshot == NULL)
+  {
+    std::cerr << "Creating surface failed: " << SDL_GetError() << std::endl;
+    return false;
+  }
+
+  // The pixels are bottom row first; let the writer walk the rows backwards
+  // rather than flipping a copy.
+  SDL_SavePNGOptions flipped = options;
+  flipped.flip = 1;
+
+  int err = SDL_SavePNG_RW_Ex(sshot, SDL_RWFromFile(filepath.c_str(), "wb"), 1, &flipped);
+  SDL_FreeSurface(sshot);
+
+  if (err != 0)
+  {
+    std::cerr << "Saving PNG failed: " << SDL_GetError() << std::endl;
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,624 @@
+#include "GLRenderer.h"
+
+#include "glew.h"
+#include "GL/GL.h"
+#include "SDL_opengl.h"
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// One end of a segment as it sits in the vertex buffer.
+struct Vertex
+{
+  GLfloat X;
+  GLfloat Y;
+  GLfloat Red;
+  GLfloat Green;
+  GLfloat Blue;
+};
+
+// One end of a segment of an instanced mesh, in segment lengths.
+struct MeshVertex
+{
+  GLfloat X;
+  GLfloat Y;
+  GLfloat Index;
+};
+
+// Where one instance of a mesh goes, with its rotation and scale folded
+// into Cosine and Sine.
+struct Placement
+{
+  GLfloat X;
+  GLfloat Y;
+  GLfloat Cosine;
+  GLfloat Sine;
+  GLfloat Index;
+};
+
+enum InstanceAttribute
+{
+  MESH_POSITION = 0,
+  MESH_INDEX = 1,
+  PLACEMENT = 2,
+  PLACEMENT_INDEX = 3
+};
+
+// Places each mesh vertex and truncates it to a whole pixel as glVertex2i
+// would, then colours it as SegmentColor does.
+static const char* INSTANCE_VERTEX_SHADER = R"(
+#version 130
+in vec2 position;
+in float index;
+in vec4 placement;
+in float first;
+
+uniform float length;
+uniform float indexScale;
+uniform float symbols;
+uniform bool colorful;
+uniform vec3 color;
+uniform float saturation;
+uniform float value;
+
+out vec3 tint;
+
+vec3 hsv(float h, float s, float v)
+{
+  int i = int(floor(h * 6.0));
+  float f = h * 6.0 - float(i);
+  float p = v * (1.0 - s);
+  float q = v * (1.0 - f * s);
+  float t = v * (1.0 - (1.0 - f) * s);
+
+  switch (i % 6)
+  {
+    case 0: return vec3(v, t, p);
+    case 1: return vec3(q, v, p);
+    case 2: return vec3(p, v, t);
+    case 3: return vec3(p, q, v);
+    case 4: return vec3(t, p, v);
+    default: return vec3(v, p, q);
+  }
+}
+
+void main()
+{
+  vec2 turned = vec2(position.x * placement.z - position.y * placement.w, position.x * placement.w + position.y * placement.z);
+  vec2 at = trunc(placement.xy + length * turned);
+  gl_Position = gl_ModelViewProjectionMatrix * vec4(at, 0.0, 1.0);
+
+  tint = colorful ? hsv((first + index * indexScale) / symbols, saturation, value) : color;
+}
+)";
+
+static const char* INSTANCE_FRAGMENT_SHADER = R"(
+#version 130
+in vec3 tint;
+out vec4 fragment;
+
+void main()
+{
+  fragment = vec4(tint, 1.0);
+}
+)";
+
+static GLuint CompileShader(GLenum type, const char* source)
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+
+  GLint compiled = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+  if (!compiled)
+  {
+    char log[1024] = "";
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    std::cerr << "Failed to compile instancing shader. Error: " << log << std::endl;
+    glDeleteShader(shader);
+    return 0;
+  }
+
+  return shader;
+}
+
+static int WindowWidth(SDL_Window* window, const ConfigurationType& config)
+{
+  int w = config.Window.Width;
+  int h = config.Window.Height;
+  if (window) SDL_GetWindowSize(window, &w, &h);
+  return w;
+}
+
+static int WindowHeight(SDL_Window* window, const ConfigurationType& config)
+{
+  int w = config.Window.Width;
+  int h = config.Window.Height;
+  if (window) SDL_GetWindowSize(window, &w, &h);
+  return h;
+}
+
+GLRenderer::GLRenderer(SDL_Window* window, std::vector<LConstant>& axiom, const ConfigurationType& config)
+  : LSystemRenderer(WindowWidth(window, config), WindowHeight(window, config), axiom, config)
+  , m_window(window)
+  , m_framebuffer(0)
+  , m_colorbuffer(0)
+  , m_vertexBuffer(0)
+  , m_uploadedVersion(0)
+  , m_uploaded(false)
+  , m_instanceProgram(0)
+  , m_meshBuffer(0)
+  , m_instanceBuffer(0)
+  , m_instancesVersion(0)
+  , m_instancesUploaded(false)
+  , m_backBufferDrawn(false)
+  , m_toScreen(true)
+{
+}
+
+GLRenderer::~GLRenderer()
+{
+  m_readback.reset();
+
+  if (m_vertexBuffer)
+  {
+    glDeleteBuffers(1, &m_vertexBuffer);
+  }
+
+  if (m_instanceProgram)
+  {
+    glDeleteProgram(m_instanceProgram);
+    glDeleteBuffers(1, &m_meshBuffer);
+    glDeleteBuffers(1, &m_instanceBuffer);
+  }
+
+  if (m_framebuffer)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteRenderbuffers(1, &m_colorbuffer);
+  }
+}
+
+bool GLRenderer::InstancingSupported()
+{
+  return GLEW_VERSION_3_3;
+}
+
+bool GLRenderer::CreateInstanceProgram()
+{
+  GLuint vertex = CompileShader(GL_VERTEX_SHADER, INSTANCE_VERTEX_SHADER);
+  GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, INSTANCE_FRAGMENT_SHADER);
+  if (!vertex || !fragment)
+  {
+    if (vertex) glDeleteShader(vertex);
+    if (fragment) glDeleteShader(fragment);
+    return false;
+  }
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, vertex);
+  glAttachShader(program, fragment);
+  glBindAttribLocation(program, MESH_POSITION, "position");
+  glBindAttribLocation(program, MESH_INDEX, "index");
+  glBindAttribLocation(program, PLACEMENT, "placement");
+  glBindAttribLocation(program, PLACEMENT_INDEX, "first");
+  glBindFragDataLocation(program, 0, "fragment");
+  glLinkProgram(program);
+
+  glDeleteShader(vertex);
+  glDeleteShader(fragment);
+
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (!linked)
+  {
+    char log[1024] = "";
+    glGetProgramInfoLog(program, sizeof(log), NULL, log);
+    std::cerr << "Failed to link instancing shader. Error: " << log << std::endl;
+    glDeleteProgram(program);
+    return false;
+  }
+
+  m_instanceProgram = program;
+  glGenBuffers(1, &m_meshBuffer);
+  glGenBuffers(1, &m_instanceBuffer);
+  return true;
+}
+
+bool GLRenderer::CreateFramebuffer()
+{
+  if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object)
+  {
+    std::cerr << "Framebuffer objects are not supported. Rendering to the window instead." << std::endl;
+    return false;
+  }
+
+  glGenRenderbuffers(1, &m_colorbuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_colorbuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_windowWidth, m_windowHeight);
+
+  glGenFramebuffers(1, &m_framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorbuffer);
+
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr << "Offscreen framebuffer is incomplete. Status: " << status << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteRenderbuffers(1, &m_colorbuffer);
+    m_framebuffer = 0;
+    m_colorbuffer = 0;
+    return false;
+  }
+
+  return true;
+}
+
+void GLRenderer::Setup(bool toScreen)
+{
+  // Pixels of a hidden window, or of no window at all, are undefined, so
+  // offscreen rendering always goes through a framebuffer object. So does
+  // progressive drawing, which adds to the image over several frames while
+  // the window's back buffer is lost on every swap.
+  bool progressive = !m_config.General.Animate && m_config.General.FrameBudget > 0.0f;
+  if ((!toScreen || progressive) && !m_framebuffer)
+  {
+    CreateFramebuffer();
+  }
+
+  m_toScreen = toScreen;
+
+  if (m_framebuffer)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+  }
+
+  if (!m_readback && PixelReadback::Supported())
+  {
+    m_readback = std::make_unique<PixelReadback>();
+  }
+
+  if (!m_vertexBuffer && GLEW_VERSION_1_5)
+  {
+    glGenBuffers(1, &m_vertexBuffer);
+  }
+
+  glViewport(0, 0, m_windowWidth, m_windowHeight);
+
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrtho(0, m_windowWidth, 0, m_windowHeight, -1, 1);
+
+  glTranslatef(0.375f, 0.375f, 0.0f);
+
+  ApplyView();
+
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+  glClearColor(m_config.General.Background.Red, m_config.General.Background.Green, m_config.General.Background.Blue, 1.0f);
+      
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+bool GLRenderer::SetView(const View& view)
+{
+  m_view = view;
+  m_progressiveDrawn = 0;
+  ApplyView();
+  return true;
+}
+
+void GLRenderer::ApplyView()
+{
+  float middleX = m_windowWidth / 2.0f;
+  float middleY = m_windowHeight / 2.0f;
+
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  glTranslatef(middleX + m_view.X, middleY + m_view.Y, 0.0f);
+  glScalef(m_view.Zoom, m_view.Zoom, 1.0f);
+  glTranslatef(-middleX, -middleY, 0.0f);
+}
+
+void GLRenderer::Clear()
+{
+  glDrawBuffer(m_framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+  glClear(GL_COLOR_BUFFER_BIT);
+  m_backBufferDrawn = true;
+}
+
+void GLRenderer::Present()
+{
+  if (m_window && !m_framebuffer)
+  {
+    SDL_GL_SwapWindow(m_window);
+    m_backBufferDrawn = false;
+  }
+  else if (m_window && m_toScreen)
+  {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glDrawBuffer(GL_BACK);
+    glBlitFramebuffer(0, 0, m_windowWidth, m_windowHeight, 0, 0, m_windowWidth, m_windowHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    SDL_GL_SwapWindow(m_window);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  }
+  else
+  {
+    glFlush();
+  }
+
+  if (m_readback)
+  {
+    m_readback->Poll(false);
+  }
+}
+
+void GLRenderer::SelectReadBuffer()
+{
+  if (m_framebuffer)
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+  else
+    glReadBuffer(m_backBufferDrawn ? GL_BACK : GL_FRONT);
+}
+
+bool GLRenderer::ReadPixels(unsigned int x, unsigned int y, unsigned int w, unsigned int h, unsigned int* pixels)
+{
+  SelectReadBuffer();
+
+  glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, pixels);
+  GLenum error = glGetError();
+  if (error != GL_NO_ERROR)
+  {
+    std::cerr << "glReadPixels error: " << error << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool GLRenderer::ReadPixelsAsync(unsigned int x, unsigned int y, unsigned int w, unsigned int h, PixelCallback callback)
+{
+  if (!m_readback)
+  {
+    return LSystemRenderer::ReadPixelsAsync(x, y, w, h, callback);
+  }
+
+  SelectReadBuffer();
+  if (m_readback->Queue(x, y, w, h, callback))
+  {
+    return true;
+  }
+
+  // Read straight away instead, after the reads already queued so that
+  // frames stay in order, rather than losing the capture.
+  FlushReads();
+  return LSystemRenderer::ReadPixelsAsync(x, y, w, h, callback);
+}
+
+void GLRenderer::FlushReads()
+{
+  if (m_readback)
+  {
+    m_readback->Poll(true);
+
+    size_t failures = m_readback->TakeFailures();
+    if (failures > 0)
+    {
+      std::cerr << failures << " captured frame" << (failures > 1 ? "s" : "") << " could not be read back and will be missing." << std::endl;
+    }
+  }
+}
+
+void GLRenderer::Upload()
+{
+  if (m_uploaded && m_uploadedVersion == m_geometryVersion)
+  {
+    return;
+  }
+
+  // Ends are truncated to whole pixels, as glVertex2i draws them.
+  std::vector<Vertex> vertices;
+  vertices.reserve(m_geometry.Segments.size() * 2);
+  for (const Segment& s : m_geometry.Segments)
+  {
+    Util::RGB rgb = SegmentColor(s);
+    vertices.push_back({ (GLfloat)(int)s.X1, (GLfloat)(int)s.Y1, rgb.Red, rgb.Green, rgb.Blue });
+    vertices.push_back({ (GLfloat)(int)s.X2, (GLfloat)(int)s.Y2, rgb.Red, rgb.Green, rgb.Blue });
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  m_uploadedVersion = m_geometryVersion;
+  m_uploaded = true;
+}
+
+void GLRenderer::DrawSegments(size_t begin, size_t end)
+{
+  m_backBufferDrawn = true;
+
+  ClampLineWidth();
+
+  if (!m_vertexBuffer)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      const Segment& s = m_geometry.Segments[i];
+
+      Util::RGB rgb = SegmentColor(s);
+      glColor4f(rgb.Red, rgb.Green, rgb.Blue, 1.0f);
+
+      DrawLine(s.X1, s.Y1, s.X2, s.Y2);
+    }
+
+    return;
+  }
+
+  if (begin >= end)
+  {
+    return;
+  }
+
+  Upload();
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, X));
+  glColorPointer(3, GL_FLOAT, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, Red));
+
+  glDrawArrays(GL_LINES, begin * 2, (end - begin) * 2);
+  glDrawArrays(GL_POINTS, begin * 2, (end - begin) * 2);
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GLRenderer::ClampLineWidth()
+{
+  GLfloat lineWidthRange[2] = {0.0f, 0.0f};
+  glGetFloatv(GL_ALIASED_LINE_WIDTH_RANGE, lineWidthRange);
+
+  if (m_lineWidth > lineWidthRange[1])
+  {
+    std::cerr << "Line width supplied (" << m_lineWidth << ") is outside supported range. Changing to " << lineWidthRange[1] << std::endl;
+    m_lineWidth = lineWidthRange[1];
+  }
+  else if (m_lineWidth < lineWidthRange[0])
+  {
+    std::cerr << "Line width supplied (" << m_lineWidth << ") is outside supported range. Changing to " << lineWidthRange[0] << std::endl;
+    m_lineWidth = lineWidthRange[0];
+  }
+
+  glLineWidth(m_lineWidth);
+  glPointSize(m_lineWidth);
+}
+
+void GLRenderer::DrawLine(float x1, float y1, float x2, float y2)
+{
+  glBegin(GL_LINES);
+  glVertex2i(x1, y1);
+  glVertex2i(x2, y2);
+  glEnd();
+
+  glBegin(GL_POINTS);
+  glVertex2i(x1, y1);
+  glVertex2i(x2, y2);
+  glEnd();
+}
+
+void GLRenderer::UploadInstances()
+{
+  if (m_instancesUploaded && m_instancesVersion == m_geometryVersion)
+  {
+    return;
+  }
+
+  std::vector<MeshVertex> vertices;
+  for (const Geometry& mesh : m_instanced.Meshes)
+  {
+    for (const Segment& s : mesh.Segments)
+    {
+      vertices.push_back({ s.X1, s.Y1, (GLfloat)s.Index });
+      vertices.push_back({ s.X2, s.Y2, (GLfloat)s.Index });
+    }
+  }
+
+  std::vector<Placement> placements;
+  placements.reserve(m_instanced.Instances.size());
+  for (const Instance& instance : m_instanced.Instances)
+  {
+    GLfloat angle = instance.Rotation * PI / 180.0f;
+    placements.push_back({ instance.X, instance.Y, cosf(angle) * instance.Scale, sinf(angle) * instance.Scale, (GLfloat)instance.Index });
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_meshBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, placements.size() * sizeof(Placement), placements.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  m_instancesVersion = m_geometryVersion;
+  m_instancesUploaded = true;
+}
+
+void GLRenderer::DrawInstances()
+{
+  if (m_instanced.Instances.empty())
+  {
+    return;
+  }
+
+  if (!m_instanceProgram && !CreateInstanceProgram())
+  {
+    return;
+  }
+
+  m_backBufferDrawn = true;
+
+  ClampLineWidth();
+  UploadInstances();
+
+  glUseProgram(m_instanceProgram);
+  glUniform1f(glGetUniformLocation(m_instanceProgram, "length"), m_instanced.Length);
+  glUniform1f(glGetUniformLocation(m_instanceProgram, "indexScale"), m_instanced.IndexScale);
+  glUniform1f(glGetUniformLocation(m_instanceProgram, "symbols"), (float)m_geometry.Symbols);
+  glUniform1i(glGetUniformLocation(m_instanceProgram, "colorful"), m_config.General.Colorful);
+  glUniform3f(glGetUniformLocation(m_instanceProgram, "color"), m_config.General.Color.Red, m_config.General.Color.Green, m_config.General.Color.Blue);
+  glUniform1f(glGetUniformLocation(m_instanceProgram, "saturation"), m_color.Saturation);
+  glUniform1f(glGetUniformLocation(m_instanceProgram, "value"), m_color.Value);
+
+  glEnableVertexAttribArray(MESH_POSITION);
+  glEnableVertexAttribArray(MESH_INDEX);
+  glEnableVertexAttribArray(PLACEMENT);
+  glEnableVertexAttribArray(PLACEMENT_INDEX);
+  glVertexAttribDivisor(PLACEMENT, 1);
+  glVertexAttribDivisor(PLACEMENT_INDEX, 1);
+
+  // Instances are grouped by mesh, so each mesh is one pair of draws.
+  size_t vertex = 0;
+  size_t first = 0;
+  for (unsigned int mesh = 0; mesh < m_instanced.Meshes.size(); ++mesh)
+  {
+    size_t vertices = m_instanced.Meshes[mesh].Segments.size() * 2;
+    size_t last = first;
+    while (last < m_instanced.Instances.size() && m_instanced.Instances[last].Mesh == mesh)
+    {
+      ++last;
+    }
+
+    if (vertices > 0 && last > first)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, m_meshBuffer);
+      glVertexAttribPointer(MESH_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const GLvoid*)(vertex * sizeof(MeshVertex) + offsetof(MeshVertex, X)));
+      glVertexAttribPointer(MESH_INDEX, 1, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const GLvoid*)(vertex * sizeof(MeshVertex) + offsetof(MeshVertex, Index)));
+
+      glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+      glVertexAttribPointer(PLACEMENT, 4, GL_FLOAT, GL_FALSE, sizeof(Placement), (const GLvoid*)(first * sizeof(Placement) + offsetof(Placement, X)));
+      glVertexAttribPointer(PLACEMENT_INDEX, 1, GL_FLOAT, GL_FALSE, sizeof(Placement), (const GLvoid*)(first * sizeof(Placement) + offsetof(Placement, Index)));
+
+      glDrawArraysInstanced(GL_LINES, 0, vertices, last - first);
+      glDrawArraysInstanced(GL_POINTS, 0, vertices, last - first);
+    }
+
+    vertex += vertices;
+    first = last;
+  }
+
+  glVertexAttribDivisor(PLACEMENT, 0);
+  glVertexAttribDivisor(PLACEMENT_INDEX, 0);
+  glDisableVertexAttribArray(MESH_POSITION);
+  glDisableVertexAttribArray(MESH_INDEX);
+  glDisableVertexAttribArray(PLACEMENT);
+  glDisableVertexAttribArray(PLACEMENT_INDEX);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glUseProgram(0);
+}
@@ -0,0 +1,133 @@
+#include "HeadlessContext.h"
+
+#include <iostream>
+
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+#endif
+
+HeadlessContext::HeadlessContext()
+  : m_display(nullptr)
+  , m_context(nullptr)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+  Destroy();
+}
+
+bool HeadlessContext::Valid() const
+{
+  return m_context != nullptr;
+}
+
+#ifdef USE_EGL
+
+bool HeadlessContext::Create()
+{
+  EGLDisplay display = EGL_NO_DISPLAY;
+
+  const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless"))
+  {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+    {
+      display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+  }
+
+  if (display == EGL_NO_DISPLAY)
+  {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+  {
+    std::cerr << "Failed to initialize EGL display. Error: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+    return false;
+  }
+  m_display = display;
+
+  const char* displayExtensions = eglQueryString(display, EGL_EXTENSIONS);
+  if (!displayExtensions || !strstr(displayExtensions, "EGL_KHR_surfaceless_context"))
+  {
+    std::cerr << "EGL display does not support surfaceless contexts." << std::endl;
+    return false;
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API))
+  {
+    std::cerr << "Failed to bind the desktop OpenGL API. Error: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+    return false;
+  }
+
+  // Nothing is ever drawn to an EGL surface, but the default surface type
+  // (window) would rule out every config on a surfaceless display.
+  const EGLint configAttribs[] =
+  {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_ALPHA_SIZE, 8,
+    EGL_NONE
+  };
+
+  EGLConfig config;
+  EGLint configCount = 0;
+  if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+  {
+    std::cerr << "Failed to choose an EGL config. Error: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+    return false;
+  }
+
+  // The renderer uses the fixed function pipeline, so ask for the default
+  // (compatibility) profile.
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+  if (context == EGL_NO_CONTEXT)
+  {
+    std::cerr << "Failed to create EGL context. Error: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+    return false;
+  }
+  m_context = context;
+
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+  {
+    std::cerr << "Failed to make EGL context current. Error: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+void HeadlessContext::Destroy()
+{
+  if (m_display)
+  {
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (m_context) eglDestroyContext(m_display, m_context);
+    eglTerminate(m_display);
+  }
+
+  m_display = nullptr;
+  m_context = nullptr;
+}
+
+#else
+
+bool HeadlessContext::Create()
+{
+  std::cerr << "Headless GL needs a build with USE_EGL defined and linked against libEGL." << std::endl;
+  return false;
+}
+
+void HeadlessContext::Destroy()
+{
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "ImageWriter.h"
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+ImageWriter::Format ImageWriter::FromPath(const std::string& path)
+{
+  std::string extension = std::filesystem::path(path).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+  if (extension == ".qoi") return Format::QOI;
+  if (extension == ".ppm") return Format::PPM;
+  if (extension == ".pam") return Format::PAM;
+  if (extension == ".raw") return Format::RAW;
+  return Format::PNG;
+}
+
+const char* ImageWriter::Extension(Format format)
+{
+  switch (format)
+  {
+    case Format::QOI: return ".qoi";
+    case Format::PPM: return ".ppm";
+    case Format::PAM: return ".pam";
+    case Format::RAW: return ".raw";
+    case Format::PNG:
+    default:
+      return ".png";
+  }
+}
+
+bool ImageWriter::IsUncompressed(Format format)
+{
+  return format == Format::PPM || format == Format::PAM || format == Format::RAW;
+}
+
+static void PutLE32(unsigned char* p, unsigned int v)
+{
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+}
+
+static void PutBE32(unsigned char* p, unsigned int v)
+{
+  p[0] = (v >> 24) & 0xFF;
+  p[1] = (v >> 16) & 0xFF;
+  p[2] = (v >> 8) & 0xFF;
+  p[3] = v & 0xFF;
+}
+
+static std::string UncompressedHeader(ImageWriter::Format format, unsigned int w, unsigned int h)
+{
+  char header[128];
+
+  switch (format)
+  {
+    case ImageWriter::Format::PPM:
+      snprintf(header, sizeof(header), "P6\n%u %u\n255\n", w, h);
+      return header;
+    case ImageWriter::Format::PAM:
+      snprintf(header, sizeof(header), "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", w, h);
+      return header;
+    default:
+    {
+      unsigned char raw[16] = { 'L', 'R', 'A', 'W' };
+      PutLE32(raw + 4, w);
+      PutLE32(raw + 8, h);
+      PutLE32(raw + 12, 4);
+      return std::string((const char*)raw, sizeof(raw));
+    }
+  }
+}
+
+static void StripAlpha(const unsigned int* src, unsigned int w, unsigned char* dst)
+{
+  for (unsigned int x = 0; x < w; ++x)
+  {
+    unsigned int p = src[x];
+    dst[3 * x]     = p & 0xFF;
+    dst[3 * x + 1] = (p >> 8) & 0xFF;
+    dst[3 * x + 2] = (p >> 16) & 0xFF;
+  }
+}
+
+bool ImageWriter::WriteUncompressed(const std::string& path, Format format, const unsigned int* pixels, unsigned int w, unsigned int h, bool mapped)
+{
+  std::string header = UncompressedHeader(format, w, h);
+  bool rgb = (format == Format::PPM);
+  size_t rowBytes = (size_t)w * (rgb ? 3 : 4);
+
+  if (mapped)
+  {
+    MappedFile file;
+    if (file.Create(path, header.size() + rowBytes * h))
+    {
+      unsigned char* out = file.Data();
+      memcpy(out, header.data(), header.size());
+      out += header.size();
+
+      for (unsigned int y = 0; y < h; ++y, out += rowBytes)
+      {
+        const unsigned int* row = pixels + (size_t)(h - 1 - y) * w;
+        if (rgb)
+          StripAlpha(row, w, out);
+        else
+          memcpy(out, row, rowBytes);
+      }
+
+      return file.Close(header.size() + rowBytes * h);
+    }
+  }
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  bool success = (fwrite(header.data(), 1, header.size(), file) == header.size());
+
+  thread_local std::vector<unsigned char> converted;
+  if (rgb) converted.resize(rowBytes);
+
+  for (unsigned int y = 0; y < h && success; ++y)
+  {
+    const unsigned int* row = pixels + (size_t)(h - 1 - y) * w;
+    if (rgb)
+    {
+      StripAlpha(row, w, converted.data());
+      success = (fwrite(converted.data(), 1, rowBytes, file) == rowBytes);
+    }
+    else
+    {
+      success = (fwrite(row, 1, rowBytes, file) == rowBytes);
+    }
+  }
+
+  return (fclose(file) == 0) && success;
+}
+
+// QOI opcodes, see https://qoiformat.org/qoi-specification.pdf
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xC0
+#define QOI_OP_RGB   0xFE
+#define QOI_OP_RGBA  0xFF
+
+static size_t QOIMaxSize(unsigned int w, unsigned int h)
+{
+  return 14 + (size_t)w * h * 5 + 8;
+}
+
+// Encodes into out, which must hold QOIMaxSize bytes. Returns the size used.
+static size_t EncodeQOI(const unsigned int* pixels, unsigned int w, unsigned int h, unsigned char* out)
+{
+  unsigned char* p = out;
+
+  memcpy(p, "qoif", 4);
+  PutBE32(p + 4, w);
+  PutBE32(p + 8, h);
+  p[12] = 4;  // RGBA
+  p[13] = 0;  // sRGB with linear alpha
+  p += 14;
+
+  unsigned int index[64] = { 0 };
+  unsigned int previous = 0xFF000000;
+  unsigned int run = 0;
+  size_t remaining = (size_t)w * h;
+
+  for (unsigned int y = 0; y < h; ++y)
+  {
+    const unsigned int* row = pixels + (size_t)(h - 1 - y) * w;
+    for (unsigned int x = 0; x < w; ++x, --remaining)
+    {
+      unsigned int px = row[x];
+      if (px == previous)
+      {
+        if (++run == 62 || remaining == 1)
+        {
+          *p++ = QOI_OP_RUN | (run - 1);
+          run = 0;
+        }
+        continue;
+      }
+
+      if (run > 0)
+      {
+        *p++ = QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+
+      int r = px & 0xFF, g = (px >> 8) & 0xFF, b = (px >> 16) & 0xFF, a = px >> 24;
+      int slot = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+
+      if (index[slot] == px)
+      {
+        *p++ = QOI_OP_INDEX | slot;
+      }
+      else
+      {
+        index[slot] = px;
+
+        if ((px >> 24) == (previous >> 24))
+        {
+          signed char dr = (signed char)(r - (int)(previous & 0xFF));
+          signed char dg = (signed char)(g - (int)((previous >> 8) & 0xFF));
+          signed char db = (signed char)(b - (int)((previous >> 16) & 0xFF));
+          signed char drg = dr - dg;
+          signed char dbg = db - dg;
+
+          if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+          {
+            *p++ = QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+          }
+          else if (drg >= -8 && drg <= 7 && dg >= -32 && dg <= 31 && dbg >= -8 && dbg <= 7)
+          {
+            *p++ = QOI_OP_LUMA | (dg + 32);
+            *p++ = ((drg + 8) << 4) | (dbg + 8);
+          }
+          else
+          {
+            *p++ = QOI_OP_RGB;
+            *p++ = r;
+            *p++ = g;
+            *p++ = b;
+          }
+        }
+        else
+        {
+          *p++ = QOI_OP_RGBA;
+          *p++ = r;
+          *p++ = g;
+          *p++ = b;
+          *p++ = a;
+        }
+      }
+
+      previous = px;
+    }
+  }
+
+  static const unsigned char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+  memcpy(p, padding, sizeof(padding));
+  p += sizeof(padding);
+
+  return p - out;
+}
+
+bool ImageWriter::WriteQOI(const std::string& path, const unsigned int* pixels, unsigned int w, unsigned int h, bool mapped)
+{
+  size_t maxSize = QOIMaxSize(w, h);
+
+  if (mapped)
+  {
+    MappedFile file;
+    if (file.Create(path, maxSize))
+    {
+      return file.Close(EncodeQOI(pixels, w, h, file.Data()));
+    }
+  }
+
+  thread_local std::vector<unsigned char> encoded;
+  encoded.resize(maxSize);
+  size_t size = EncodeQOI(pixels, w, h, encoded.data());
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  bool success = (fwrite(encoded.data(), 1, size, file) == size);
+  return (fclose(file) == 0) && success;
+}
@@ -3,13 +3,16 @@
 
 #include <iostream>
 #include <algorithm>
+#include <iterator>
 #include <utility>
 #include <random>
 #include <chrono>
 
 LSystem::LSystem()
   : m_generator(std::chrono::system_clock::now().time_since_epoch().count())
-  , m_distribution(0.0f, 1.0f)
+  , m_seed(0)
+  , m_keepGenerations(0)
+  , m_retainGenerations(true)
 {
 }
 
@@ -19,6 +22,10 @@ LSystem::~LSystem()
 
 void LSystem::Configure(SystemConfigType& config)
 {
+  m_seed = config.Seed;
+  m_keepGenerations = config.KeepGenerations;
+  ClearGenerations();
+
   for (auto c : config.Constants)
   {
     if (c.second == "MOVE_FORWARD")
@@ -92,36 +99,214 @@ void LSystem::AddConstant(char value, ActionEnum action)
 
 bool LSystem::SetAxiom(std::string axiom)
 {
+  ClearGenerations();
   return SplitStringIntoConstants(axiom, m_axiom);
 }
 
-std::vector<LConstant> LSystem::GenerateNthAxiom(unsigned int n)
+std::vector<LConstant> LSystem::GenerateNthAxiom(unsigned int n, Progress* progress)
+{
+  Generation* generation = Climb(n, progress);
+  return generation != NULL ? generation->Axiom : std::vector<LConstant>();
+}
+
+std::vector<LConstant> LSystem::ReleaseNthAxiom(unsigned int n, Progress* progress)
 {
+  Generation* generation = Climb(n, progress);
+  if (generation == NULL)
+  {
+    return std::vector<LConstant>();
+  }
+
+  std::vector<LConstant> axiom;
   if (n == 0)
   {
-    return m_axiom;
+    axiom = generation->Axiom;
+  }
+  else
+  {
+    axiom.swap(generation->Axiom);
+    m_generations.erase(m_generations.upper_bound(0), m_generations.end());
+  }
+
+  return axiom;
+}
+
+void LSystem::RetainGenerations(bool retain)
+{
+  m_retainGenerations = retain;
+}
+
+LSystem::Generation* LSystem::Climb(unsigned int n, Progress* progress)
+{
+  auto found = m_generations.find(n);
+  if (found != m_generations.end())
+  {
+    return &found->second;
   }
-  
-  std::vector<LConstant> output;
-  auto precursor = GenerateNthAxiom(n - 1);
 
-  for (const LConstant& c : precursor)
+  if (m_generations.empty())
   {
+    // Without a seed each ladder starts from a fresh stream, so clearing it
+    // and expanding again gives a new result.
+    Generation& first = m_generations[0];
+    first.Axiom = m_axiom;
+    first.Generator.seed(m_seed != 0 ? m_seed : m_generator());
+  }
+
+  // Continue from the highest generation below n still on the ladder.
+  auto base = std::prev(m_generations.upper_bound(n));
+  Generation* previous = &base->second;
+
+  // Progress is weighted by symbols expanded, assuming the generations still
+  // to come grow at the rate of the last one.
+  double work = 0.0;
+  double growth = 1.0;
+
+  for (unsigned int g = base->first + 1; g <= n; ++g)
+  {
+    double remaining = 0.0;
+    double size = previous->Axiom.size();
+    for (unsigned int k = g; k <= n; ++k, size *= growth)
+    {
+      remaining += size;
+    }
+
+    Generation next;
+    next.Generator = previous->Generator;
+
+    // A generation interrupted part way never joins the ladder.
+    double total = std::max(work + remaining, 1.0);
+    if (!Expand(previous->Axiom, next.Axiom, next.Generator, progress, work / total, previous->Axiom.size() / total))
+    {
+      return NULL;
+    }
+
+    if (!previous->Axiom.empty())
+    {
+      growth = std::max((double)next.Axiom.size() / previous->Axiom.size(), 1.0);
+    }
+    work += previous->Axiom.size();
+
+    previous = &(m_generations[g] = std::move(next));
+
+    // Without retention each rung goes as soon as the next is derived.
+    if (!m_retainGenerations && g > 1)
+    {
+      m_generations.erase(g - 1);
+    }
+  }
+
+  // Drop rungs too far below n, always keeping the original axiom.
+  if (!m_retainGenerations)
+  {
+    m_generations.erase(m_generations.upper_bound(0), m_generations.lower_bound(n));
+    m_generations.erase(m_generations.upper_bound(n), m_generations.end());
+  }
+  else if (m_keepGenerations > 0 && n > m_keepGenerations)
+  {
+    m_generations.erase(m_generations.upper_bound(0), m_generations.lower_bound(n - m_keepGenerations));
+  }
+
+  return previous;
+}
+
+std::vector<LConstant> LSystem::GenerateNthAxiom(unsigned int n, unsigned int seed, Progress* progress) const
+{
+  std::mt19937 generator(seed);
+  std::vector<LConstant> axiom = m_axiom;
+  std::vector<LConstant> next;
+
+  // Each generation is weighted equally in the progress reported.
+  for (unsigned int g = 0; g < n; ++g)
+  {
+    if (!Expand(axiom, next, generator, progress, (float)g / n, 1.0f / n))
+    {
+      return std::vector<LConstant>();
+    }
+
+    axiom.swap(next);
+  }
+
+  return axiom;
+}
+
+void LSystem::ClearGenerations()
+{
+  m_generations.clear();
+}
+
+bool LSystem::Reproducible() const
+{
+  return m_seed != 0 || Deterministic();
+}
+
+bool LSystem::Deterministic() const
+{
+  for (auto& rules : m_constantRules)
+  {
+    if (rules.second.size() != 1 || rules.second[0].Weight < 1.0f)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+const std::vector<LConstant>* LSystem::Successor(const LConstant& c) const
+{
+  auto rules = m_constantRules.find(c);
+  if (rules == m_constantRules.end() || rules->second.empty())
+  {
+    return NULL;
+  }
+
+  return &rules->second[0].Expansion;
+}
+
+const std::vector<LConstant>& LSystem::Axiom() const
+{
+  return m_axiom;
+}
+
+const std::vector<LConstant>& LSystem::Constants() const
+{
+  return m_constants;
+}
+
+bool LSystem::Expand(const std::vector<LConstant>& input, std::vector<LConstant>& output, std::mt19937& generator,
+  Progress* progress, float done, float share) const
+{
+  std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+  output.clear();
+
+  for (size_t i = 0; i < input.size(); ++i)
+  {
+    if (progress != NULL && i % PROGRESS_INTERVAL == 0)
+    {
+      if (progress->Cancelled())
+      {
+        return false;
+      }
+
+      progress->Report("Expanding", done + share * i / input.size());
+    }
+
+    const LConstant& c = input[i];
     auto constantRules = m_constantRules.find(c);
 
-    float r = m_distribution(m_generator);
+    float r = distribution(generator);
     float totWeight = 0;
     
     if (constantRules != m_constantRules.end())
     {
-      auto rules = constantRules->second;
-      bool picked = false;
-      for (int i = 0; i < rules.size(); ++i)
+      const auto& rules = constantRules->second;
+      for (size_t k = 0; k < rules.size(); ++k)
       {
-        totWeight += rules[i].Weight;
+        totWeight += rules[k].Weight;
         if (r < totWeight)
         {
-          output.insert(output.end(), rules[i].Expansion.begin(), rules[i].Expansion.end());
+          output.insert(output.end(), rules[k].Expansion.begin(), rules[k].Expansion.end());
           break;
         }
       }
@@ -133,7 +318,7 @@ std::vector<LConstant> LSystem::GenerateNthAxiom(unsigned int n)
     }
   }
 
-  return output;
+  return true;
 }
 
 bool LSystem::SetConstantRule(char constant, float weight, std::string rule)
@@ -153,6 +338,7 @@ bool LSystem::SetConstantRule(char constant, float weight, std::string rule)
   {
     Rule rule(weight, ruleVec);
     m_constantRules[*c].push_back(rule);
+    ClearGenerations();
   }
 
   return success;
@@ -1,19 +1,44 @@
 #include "LSystemRenderer.h"
 
-#include "glew.h"
-#include "GL/GL.h"
-#include "SDL_opengl.h"
-#include "savepng.h"
+#include "ApngWriter.h"
+#include "VideoWriter.h"
+
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <filesystem>
 #include <iostream>
-#include <limits>
+#include <random>
 
-LSystemRenderer::LSystemRenderer(SDL_Window* window, std::vector<LConstant>& axiom, const ConfigurationType& config)
-  : m_window(window)
-  , m_axiom(axiom)
-  , m_stateStack()
+// Segments drawn between checks of the clock when drawing progressively.
+#define PROGRESSIVE_BATCH 4096
+
+// Share of the window's shorter side a level of detail image spans.
+#define LOD_FILL 0.9f
+
+// Share of its cell each variant of an atlas spans.
+#define ATLAS_FILL 0.9f
+
+// Fewest symbols per piece when an axiom is walked in pieces on several
+// threads; below twice this it is walked in one go.
+#define CHECKPOINT_INTERVAL 262144
+
+// Pixels below which level of detail collapses subtrees while sizing and
+// centring the image, which only needs its outline.
+#define LOD_OUTLINE 4.0f
+
+LSystemRenderer::LSystemRenderer(int width, int height, std::vector<LConstant>& axiom, const ConfigurationType& config)
+  : m_config(config)
+  , m_pool(config.Window.Threads)
+  , m_windowWidth(width)
+  , m_windowHeight(height)
   , m_drawIndex(0)
-  , m_config(config)
+  , m_progressiveDrawn(0)
+  , m_axiom(axiom)
+  , m_geometryVersion(0)
+  , m_interpreted(false)
+  , m_cache(NULL)
+  , m_axiomKey(0)
 {
   m_color.Hue = 0;
   m_color.Saturation = m_config.General.Saturation;
@@ -23,8 +48,6 @@ LSystemRenderer::LSystemRenderer(SDL_Window* window, std::vector<LConstant>& axi
 
   m_origX = (m_config.General.FixedX != -1) ? m_config.General.FixedX : 0.0f;
   m_origY = (m_config.General.FixedY != -1) ? m_config.General.FixedY : 0.0f;
-
-  SDL_GetWindowSize(m_window, &m_windowWidth, &m_windowHeight);
 }
 
 LSystemRenderer::~LSystemRenderer()
@@ -35,334 +58,741 @@ void LSystemRenderer::SetOrigin(float x, float y)
 {
   m_origX = x;
   m_origY = y;
+  m_interpreted = false;
+}
+
+void LSystemRenderer::Bounds(float& minX, float& minY, float& maxX, float& maxY) const
+{
+  minX = m_minX;
+  minY = m_minY;
+  maxX = m_maxX;
+  maxY = m_maxY;
+}
+
+void LSystemRenderer::Restyle()
+{
+  m_color.Saturation = m_config.General.Saturation;
+  m_lineWidth = m_config.General.LineWidth;
+  m_drawIndex = 0;
+  m_progressiveDrawn = 0;
+
+  // Nothing already drawn can be kept.
+  ++m_geometryVersion;
 }
 
 void LSystemRenderer::SetAxiom(std::vector<LConstant>& axiom)
 {
   m_axiom = axiom;
+  m_drawIndex = 0;
+  m_progressiveDrawn = 0;
+  m_interpreted = false;
+  m_axiomKey = 0;
 }
 
-void LSystemRenderer::Center()
+void LSystemRenderer::SetCache(ExpansionCache* cache, uint64_t axiomKey)
+{
+  m_cache = cache;
+  m_axiomKey = axiomKey;
+}
+
+bool LSystemRenderer::Walk(const std::vector<LConstant>& axiom, uint64_t axiomKey, float x, float y, Geometry& geometry, Progress* progress, float scale,
+  std::vector<Turtle::Checkpoint>* record, const std::vector<Turtle::Checkpoint>* resume) const
 {
-  m_x = m_origX;
-  m_y = m_origY;
-  m_currRot = m_config.General.StartingRotation;
-  m_stateStack = std::stack<RendererState>();
+  if (record != NULL) record->clear();
 
-  m_minX = std::numeric_limits<float>::max();
-  m_maxX = std::numeric_limits<float>::min();
+  uint64_t key = 0;
+  if (m_cache != NULL && axiomKey != 0 && scale == 1.0f)
+  {
+    key = ExpansionCache::GeometryKey(axiomKey, m_config.General, x, y);
+    if (m_cache->LoadGeometry(key, geometry))
+    {
+      return true;
+    }
+  }
 
-  m_minY = std::numeric_limits<float>::max();
-  m_maxY = std::numeric_limits<float>::min();
+  Turtle turtle(m_config.General, scale);
+  turtle.Reset(x, y);
 
-  for (auto iter = m_axiom.begin(); iter != m_axiom.end(); ++iter)
+  geometry = Geometry();
+  bool split = m_pool.Size() > 1 && axiom.size() >= 2 * CHECKPOINT_INTERVAL;
+  if (!split || resume == NULL || resume->empty())
   {
-    float new_x = m_x + m_config.General.Length * cosf(m_currRot * PI / 180.0f);
-    float new_y = m_y + m_config.General.Length * sinf(m_currRot * PI / 180.0f);
+    size_t interval = std::max(axiom.size() / (m_pool.Size() * 4), (size_t)CHECKPOINT_INTERVAL);
+    if (!turtle.Interpret(axiom, 0, axiom.size(), geometry, progress, split ? record : NULL, interval))
+    {
+      return false;
+    }
+  }
+  else
+  {
+    // Heading and pushed state don't depend on the origin, so the earlier
+    // walk's checkpoints only need moving by the difference in origins.
+    const std::vector<Turtle::Checkpoint>& checkpoints = *resume;
+    float dx = x - checkpoints[0].State.X;
+    float dy = y - checkpoints[0].State.Y;
+
+    std::vector<Geometry> pieces(checkpoints.size());
+    m_pool.ParallelFor(pieces.size(), [&](size_t i)
+    {
+      size_t end = (i + 1 < checkpoints.size()) ? checkpoints[i + 1].Symbol : axiom.size();
+      Turtle piece(m_config.General, scale);
+      piece.Restore(checkpoints[i], dx, dy);
+      piece.Interpret(axiom, checkpoints[i].Symbol, end, pieces[i], progress);
+    });
 
-    RendererState s;
-    switch (iter->Action)
+    if (progress != NULL && progress->Cancelled())
     {
-      case ActionEnum::DRAW_FORWARD:
-        m_x = new_x;
-        m_y = new_y;
-        break;
-      case ActionEnum::MOVE_FORWARD:
-        m_x = new_x;
-        m_y = new_y;
-        break;
-      case ActionEnum::ROTATE_CW:
-        m_currRot += m_config.General.Angle;
-        m_currRot = fmodf(m_currRot, 360.0f);
-        break;
-      case ActionEnum::ROTATE_CCW:
-        m_currRot -= m_config.General.Angle;
-        m_currRot = fmodf(m_currRot, 360.0f);
-        break;
-      case ActionEnum::PUSH_STATE:
-        s.X = m_x;
-        s.Y = m_y;
-        s.Rotation = m_currRot;
-        m_stateStack.push(s);
-        break;
-      case ActionEnum::POP_STATE:
-        s = m_stateStack.top();
-        m_stateStack.pop();
-        m_x = s.X;
-        m_y = s.Y;
-        m_currRot = s.Rotation;
-        break;
-      case ActionEnum::NO_ACTION:
-      default:
-        break;
+      return false;
     }
 
-    if (m_x > m_maxX) m_maxX = m_x;
-    if (m_x < m_minX) m_minX = m_x;
-    if (m_y > m_maxY) m_maxY = m_y;
-    if (m_y < m_minY) m_minY = m_y;
+    size_t segments = 0;
+    for (const Geometry& piece : pieces) segments += piece.Segments.size();
+    geometry.Segments.reserve(segments);
+
+    for (Geometry& piece : pieces)
+    {
+      geometry.Segments.insert(geometry.Segments.end(), piece.Segments.begin(), piece.Segments.end());
+      piece.Segments = std::vector<Segment>();
+
+      geometry.Symbols += piece.Symbols;
+      geometry.MinX = std::min(geometry.MinX, piece.MinX);
+      geometry.MinY = std::min(geometry.MinY, piece.MinY);
+      geometry.MaxX = std::max(geometry.MaxX, piece.MaxX);
+      geometry.MaxY = std::max(geometry.MaxY, piece.MaxY);
+    }
   }
 
-  float centerX = (m_maxX + m_minX) / 2.0f;
-  float centerY = (m_maxY + m_minY) / 2.0f;
+  if (key != 0) m_cache->StoreGeometry(key, geometry);
+  return true;
+}
+
+void LSystemRenderer::Interpret(const std::vector<Turtle::Checkpoint>* resume)
+{
+  Walk(m_axiom, m_axiomKey, m_origX, m_origY, m_geometry, NULL, 1.0f, NULL, resume);
+  m_instanced = InstancedGeometry();
+
+  m_minX = m_geometry.MinX;
+  m_maxX = m_geometry.MaxX;
+  m_minY = m_geometry.MinY;
+  m_maxY = m_geometry.MaxY;
+
+  ++m_geometryVersion;
+  m_interpreted = true;
+  m_progressiveDrawn = 0;
+}
+
+void LSystemRenderer::CenterOrigin(const Geometry& geometry, float& x, float& y, bool quiet) const
+{
+  float centerX = (geometry.MaxX + geometry.MinX) / 2.0f;
+  float centerY = (geometry.MaxY + geometry.MinY) / 2.0f;
 
   float diffX = centerX - (static_cast<float>(m_windowWidth) / 2.0f);
   float diffY = centerY - (static_cast<float>(m_windowHeight) / 2.0f);
 
-  int width = std::abs(m_maxX - m_minX);
-  int height = std::abs(m_maxY - m_minY);
-  std::cout << "Resultant curve is " << width << " pixels by " << height << " pixels." << std::endl;
-  if (width > m_windowWidth || height > m_windowHeight)
+  if (!quiet)
   {
-    std::cout << "Warning: Resultant curve is larger than current window size and will be partially obscured." << std::endl;
-  }
+    int width = std::abs(geometry.MaxX - geometry.MinX);
+    int height = std::abs(geometry.MaxY - geometry.MinY);
+    std::cout << "Resultant curve is " << width << " pixels by " << height << " pixels." << std::endl;
+    if (width > m_windowWidth || height > m_windowHeight)
+    {
+      std::cout << "Warning: Resultant curve is larger than current window size and will be partially obscured." << std::endl;
+    }
 
-  std::cout << "Adjusting origin by (" << diffX << ", " << diffY << ")." << std::endl; 
+    std::cout << "Adjusting origin by (" << diffX << ", " << diffY << ")." << std::endl; 
+  }
 
   if (m_config.General.FixedX == -1)
   {
-    m_minX -= (int)diffX;
-    m_maxX -= (int)diffX;
-    m_origX -= (int)diffX;
+    x -= (int)diffX;
   }
 
   if (m_config.General.FixedY == -1)
   {
-    m_minY -= (int)diffY;
-    m_maxY -= (int)diffY;
-    m_origY -= (int)diffY;
+    y -= (int)diffY;
   }
 }
 
-bool LSystemRenderer::SaveScreenshot(const std::string& filepath, int padding)
+void LSystemRenderer::Center()
 {
-  unsigned int width = std::abs(m_maxX - m_minX) + (2 * padding);
-  unsigned int height = std::abs(m_maxY - m_minY) + (2 * padding);
+  std::vector<Turtle::Checkpoint> checkpoints;
+  Walk(m_axiom, m_axiomKey, m_origX, m_origY, m_geometry, NULL, 1.0f, &checkpoints);
+  CenterOrigin(m_geometry, m_origX, m_origY);
+  Interpret(&checkpoints);
+}
 
-  unsigned int x, y, w, h;
-  if (width > m_windowWidth)
+bool LSystemRenderer::Prepare(const std::vector<LConstant>& axiom, uint64_t axiomKey, Geometry& geometry, float& x, float& y, Progress* progress, float scale) const
+{
+  x = (m_config.General.FixedX != -1) ? m_config.General.FixedX : 0.0f;
+  y = (m_config.General.FixedY != -1) ? m_config.General.FixedY : 0.0f;
+
+  // Centring walks twice, and the second walk resumes in pieces from
+  // where the first passed.
+  std::vector<Turtle::Checkpoint> checkpoints;
+  if (!Walk(axiom, axiomKey, x, y, geometry, progress, scale, m_config.General.Center ? &checkpoints : NULL))
   {
-    x = 0;
-    w = m_windowWidth;
+    return false;
   }
-  else
+
+  if (m_config.General.Center)
   {
-    x = m_minX - padding;
-    w = width;
+    CenterOrigin(geometry, x, y);
+    return Walk(axiom, axiomKey, x, y, geometry, progress, scale, NULL, &checkpoints);
   }
-  
-  if (height > m_windowHeight)
+
+  return true;
+}
+
+bool LSystemRenderer::PrepareLevelOfDetail(const LSystem& system, unsigned int n, const View& view, Geometry& geometry, float& x, float& y, Progress* progress) const
+{
+  LevelOfDetail lod(system, m_config.General);
+
+  x = (m_config.General.FixedX != -1) ? m_config.General.FixedX : 0.0f;
+  y = (m_config.General.FixedY != -1) ? m_config.General.FixedY : 0.0f;
+
+  // The reach only bounds the size of the image, so the length it gives is
+  // corrected by how large the first walk actually came out.
+  float outline = std::max(m_config.General.Lod, LOD_OUTLINE);
+  float size = LOD_FILL * std::min(m_windowWidth, m_windowHeight);
+  float length = size / std::max(2.0f * lod.Reach(n), 1.0f);
+  if (!lod.Interpret(n, length, outline, x, y, geometry, progress))
   {
-    y = 0;
-    h = m_windowHeight;
+    return false;
   }
-  else
+
+  float extent = std::max(geometry.MaxX - geometry.MinX, geometry.MaxY - geometry.MinY);
+  if (extent > 0.0f)
   {
-    y = m_minY - padding;
-    h = height;
+    length *= size / extent;
   }
 
-  size_t arraySize = w * h;
-  unsigned int* pixels = new unsigned int[arraySize];
+  if (m_config.General.Center)
+  {
+    if (!lod.Interpret(n, length, outline, x, y, geometry, progress))
+    {
+      return false;
+    }
+
+    CenterOrigin(geometry, x, y);
+  }
+
+  // Zoom about the middle of the window, then pan, and walk only what lands
+  // inside the window.
+  float middleX = m_windowWidth / 2.0f;
+  float middleY = m_windowHeight / 2.0f;
+  x = middleX + (x - middleX) * view.Zoom + view.X;
+  y = middleY + (y - middleY) * view.Zoom + view.Y;
 
-  glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, pixels);
-  GLenum error = glGetError();
-  if (error != GL_NO_ERROR)
+  lod.Cull(0.0f, 0.0f, m_windowWidth, m_windowHeight);
+  if (!lod.Interpret(n, length * view.Zoom, m_config.General.Lod, x, y, geometry, progress))
   {
-    std::cerr << "glReadPixels error: " << error << std::endl;
     return false;
   }
 
-  SDL_Surface* sshot = SDL_CreateRGBSurfaceFrom(pixels, w, h, 8*4, w*4, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
-  if (sshot == NULL)
+  // The turtle still passes through places off screen, but only the window
+  // can be captured.
+  geometry.MinX = std::max(geometry.MinX, 0.0f);
+  geometry.MinY = std::max(geometry.MinY, 0.0f);
+  geometry.MaxX = std::min(geometry.MaxX, (float)m_windowWidth);
+  geometry.MaxY = std::min(geometry.MaxY, (float)m_windowHeight);
+  return true;
+}
+
+bool LSystemRenderer::PrepareInstanced(const LSystem& system, unsigned int n, Geometry& geometry, InstancedGeometry& instanced, float& x, float& y, Progress* progress) const
+{
+  LevelOfDetail lod(system, m_config.General);
+
+  x = (m_config.General.FixedX != -1) ? m_config.General.FixedX : 0.0f;
+  y = (m_config.General.FixedY != -1) ? m_config.General.FixedY : 0.0f;
+
+  if (!lod.Instance(n, m_config.General.Length, x, y, geometry, instanced, progress))
+  {
+    return false;
+  }
+
+  if (m_config.General.Center)
+  {
+    CenterOrigin(geometry, x, y);
+    return lod.Instance(n, m_config.General.Length, x, y, geometry, instanced, progress);
+  }
+
+  return true;
+}
+
+bool LSystemRenderer::PrepareScene(const LSystem& system, unsigned int n, Geometry& geometry, InstancedGeometry& instanced, float& x, float& y, Progress* progress) const
+{
+  const SceneConfigType& scene = m_config.Scene;
+
+  // Without a seed every preparation picks new variants and a new layout.
+  std::random_device entropy;
+  unsigned int variantSeed = (m_config.System.Seed != 0) ? m_config.System.Seed : entropy();
+  std::mt19937 layout((scene.Seed != 0) ? scene.Seed : entropy());
+
+  // Every variant of a system without weighted rules is the same.
+  int variants = system.Deterministic() ? 1 : std::max(scene.Variants, 1);
+
+  instanced = InstancedGeometry();
+  instanced.Length = (float)m_config.General.Length;
+
+  if (!PrepareVariants(system, n, variantSeed, variants, 1.0f / m_config.General.Length, NULL, instanced.Meshes, progress))
   {
-    std::cerr << "Creating surface failed: " << SDL_GetError() << std::endl;
     return false;
   }
 
-  if (sshot->h > 2)
+  geometry = Geometry();
+  geometry.Symbols = 1;
+  for (const Geometry& mesh : instanced.Meshes)
   {
-    Uint8 *t;
-    Uint8 *a, *b;
-    Uint8 *last;
-    Uint16 pitch;
+    geometry.Symbols = std::max(geometry.Symbols, mesh.Symbols);
+  }
+
+  x = (m_config.General.FixedX != -1) ? m_config.General.FixedX : 0.0f;
+  y = (m_config.General.FixedY != -1) ? m_config.General.FixedY : 0.0f;
 
-    /* get a place to store a line */
-    pitch = sshot->pitch;
-    t = (Uint8*)malloc(pitch);
+  // Copies stand on a strip width pixels across and depth deep, centred on
+  // the origin and running back from it.
+  std::uniform_real_distribution<float> across(-scene.Width / 2.0f, scene.Width / 2.0f);
+  std::uniform_real_distribution<float> back(0.0f, (float)std::max(scene.Depth, 0));
+  std::uniform_real_distribution<float> scale(scene.MinScale, std::max(scene.MinScale, scene.MaxScale));
+  std::uniform_real_distribution<float> tilt(-scene.Tilt, scene.Tilt);
+  std::uniform_int_distribution<unsigned int> pick(0, variants - 1);
 
-    if (t == NULL) {
-        std::cerr << "Failed while flipping surface." << std::endl;
-        return false;
+  for (int i = 0; i < scene.Count; ++i)
+  {
+    Instance instance;
+    instance.X = x + across(layout);
+    instance.Y = y + back(layout);
+    instance.Scale = scale(layout);
+    instance.Rotation = tilt(layout);
+    instance.Mesh = pick(layout);
+    instance.Index = 0;
+    instanced.Instances.push_back(instance);
+
+    // The corners of the mesh's bounds, turned and scaled into place.
+    const Geometry& mesh = instanced.Meshes[instance.Mesh];
+    float cosine = cosf(instance.Rotation * PI / 180.0f) * instance.Scale * instanced.Length;
+    float sine = sinf(instance.Rotation * PI / 180.0f) * instance.Scale * instanced.Length;
+    for (float cornerX : { mesh.MinX, mesh.MaxX })
+    {
+      for (float cornerY : { mesh.MinY, mesh.MaxY })
+      {
+        float placedX = instance.X + cornerX * cosine - cornerY * sine;
+        float placedY = instance.Y + cornerX * sine + cornerY * cosine;
+        geometry.MinX = std::min(geometry.MinX, placedX);
+        geometry.MinY = std::min(geometry.MinY, placedY);
+        geometry.MaxX = std::max(geometry.MaxX, placedX);
+        geometry.MaxY = std::max(geometry.MaxY, placedY);
+      }
     }
+  }
 
-    /* get first line; it's about to be trampled */
-    memcpy(t, sshot->pixels,pitch);
+  std::stable_sort(instanced.Instances.begin(), instanced.Instances.end(), [](const Instance& a, const Instance& b) { return a.Mesh < b.Mesh; });
 
-    /* now, shuffle the rest so it's almost correct */
-    a = (Uint8*)sshot->pixels;
-    last = a + pitch * (sshot->h - 1);
-    b = last;
+  if (m_config.General.Center && !instanced.Instances.empty())
+  {
+    float startX = x;
+    float startY = y;
+    CenterOrigin(geometry, x, y);
 
-    while(a < b) {
-        memcpy(a,b,pitch);
-        a += pitch;
-        memcpy(b,a,pitch);
-        b -= pitch;
+    float dx = x - startX;
+    float dy = y - startY;
+    for (Instance& instance : instanced.Instances)
+    {
+      instance.X += dx;
+      instance.Y += dy;
     }
 
-    /* in this shuffled state, the bottom slice is too far down */
-    memmove( b, b+pitch, last-b );
-    /* now we can put back that first row--in the last place */
-    memcpy(last,t,pitch);
-    /* everything is in the right place; close up. */
-    free(t);
+    geometry.MinX += dx;
+    geometry.MaxX += dx;
+    geometry.MinY += dy;
+    geometry.MaxY += dy;
+  }
+
+  return true;
+}
+
+bool LSystemRenderer::PrepareVariants(const LSystem& system, unsigned int n, unsigned int seed, unsigned int count, float scale, ThreadPool* pool,
+  std::vector<Geometry>& variants, Progress* progress) const
+{
+  variants.assign(count, Geometry());
+
+  auto prepare = [&](size_t i)
+  {
+    std::vector<LConstant> axiom = system.GenerateNthAxiom(n, seed + (unsigned int)i, progress);
+    if (progress != NULL && progress->Cancelled())
+    {
+      return;
+    }
+
+    Turtle turtle(m_config.General, scale);
+    turtle.Reset(0.0f, 0.0f);
+    turtle.Interpret(axiom, variants[i], progress);
+  };
+
+  if (pool != NULL)
+  {
+    pool->ParallelFor(count, prepare);
+  }
+  else
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      prepare(i);
+    }
+  }
+
+  return progress == NULL || !progress->Cancelled();
+}
+
+void LSystemRenderer::Position(Geometry& geometry, float& x, float& y) const
+{
+  x = (m_config.General.FixedX != -1) ? m_config.General.FixedX : 0.0f;
+  y = (m_config.General.FixedY != -1) ? m_config.General.FixedY : 0.0f;
+
+  if (m_config.General.Center)
+  {
+    CenterOrigin(geometry, x, y, true);
   }
 
-  int err = SDL_SavePNG(sshot, filepath.c_str());
-  if (err != 0)
+  for (Segment& s : geometry.Segments)
+  {
+    s.X1 += x;
+    s.Y1 += y;
+    s.X2 += x;
+    s.Y2 += y;
+  }
+
+  geometry.MinX += x;
+  geometry.MaxX += x;
+  geometry.MinY += y;
+  geometry.MaxY += y;
+}
+
+bool LSystemRenderer::PrepareSweep(const std::vector<LConstant>& axiom, unsigned int frame, Geometry& geometry, float& x, float& y, Progress* progress) const
+{
+  const SweepConfigType& sweep = m_config.Sweep;
+  float t = (sweep.Frames > 1) ? (float)frame / (sweep.Frames - 1) : 0.0f;
+  float value = sweep.Start + (sweep.End - sweep.Start) * t;
+
+  GeneralConfigType general = m_config.General;
+  float scale = 1.0f;
+  if (sweep.Parameter == "angle")
+  {
+    general.Angle = value;
+  }
+  else if (sweep.Parameter == "startingrotation")
+  {
+    general.StartingRotation = value;
+  }
+  else if (sweep.Parameter == "length")
+  {
+    // The configured length is a whole number of pixels; the scale isn't.
+    general.Length = 1;
+    scale = value;
+  }
+
+  Turtle turtle(general, scale);
+  turtle.Reset(0.0f, 0.0f);
+
+  geometry = Geometry();
+  if (!turtle.Interpret(axiom, geometry, progress))
   {
-    std::cerr << "Saving PNG failed: " << SDL_GetError() << std::endl;
     return false;
   }
 
-  SDL_FreeSurface(sshot);
-  delete[] pixels;
+  Position(geometry, x, y);
+  return true;
+}
+
+bool LSystemRenderer::PrepareAtlas(const std::vector<Geometry>& variants, Geometry& geometry, InstancedGeometry& instanced) const
+{
+  if (variants.empty())
+  {
+    return false;
+  }
+
+  // About as many columns as rows, leaning towards the window's shape.
+  float aspect = (float)m_windowWidth / m_windowHeight;
+  unsigned int columns = std::max((unsigned int)std::round(std::sqrt(variants.size() * aspect)), 1u);
+  columns = std::min(columns, (unsigned int)variants.size());
+  unsigned int rows = (variants.size() + columns - 1) / columns;
+
+  float cellWidth = (float)m_windowWidth / columns;
+  float cellHeight = (float)m_windowHeight / rows;
+
+  instanced = InstancedGeometry();
+  instanced.Meshes = variants;
+
+  geometry = Geometry();
+  geometry.Symbols = 1;
+  geometry.MinX = 0.0f;
+  geometry.MinY = 0.0f;
+  geometry.MaxX = (float)m_windowWidth;
+  geometry.MaxY = (float)m_windowHeight;
+
+  for (unsigned int i = 0; i < variants.size(); ++i)
+  {
+    const Geometry& mesh = variants[i];
+    geometry.Symbols = std::max(geometry.Symbols, mesh.Symbols);
+
+    // The first variant goes top left, as it reads.
+    float width = std::max(mesh.MaxX - mesh.MinX, 1.0f);
+    float height = std::max(mesh.MaxY - mesh.MinY, 1.0f);
+    float cellX = (i % columns + 0.5f) * cellWidth;
+    float cellY = m_windowHeight - (i / columns + 0.5f) * cellHeight;
+
+    Instance instance;
+    instance.Scale = ATLAS_FILL * std::min(cellWidth / width, cellHeight / height);
+    instance.X = cellX - (mesh.MinX + mesh.MaxX) / 2.0f * instance.Scale;
+    instance.Y = cellY - (mesh.MinY + mesh.MaxY) / 2.0f * instance.Scale;
+    instance.Rotation = 0.0f;
+    instance.Mesh = i;
+    instance.Index = 0;
+    instanced.Instances.push_back(instance);
+  }
 
   return true;
 }
 
-void LSystemRenderer::DrawLine(float x1, float y1, float x2, float y2)
+void LSystemRenderer::AdoptInstances(InstancedGeometry& instanced)
+{
+  m_instanced = std::move(instanced);
+  ++m_geometryVersion;
+}
+
+void LSystemRenderer::Adopt(Geometry& geometry, float x, float y, uint64_t axiomKey)
+{
+  m_geometry = std::move(geometry);
+  m_instanced = InstancedGeometry();
+  m_origX = x;
+  m_origY = y;
+  m_axiomKey = axiomKey;
+
+  m_minX = m_geometry.MinX;
+  m_maxX = m_geometry.MaxX;
+  m_minY = m_geometry.MinY;
+  m_maxY = m_geometry.MaxY;
+
+  m_drawIndex = 0;
+  m_progressiveDrawn = 0;
+  ++m_geometryVersion;
+  m_interpreted = true;
+}
+
+// Keeps a span starting at start inside [0, limit), as a zoomed or panned
+// view can move part of the geometry out of the window.
+static void ClampSpan(float start, unsigned int length, unsigned int limit, unsigned int& offset, unsigned int& size)
+{
+  if (start < 0.0f)
+  {
+    length = (length > -start) ? length - (unsigned int)-start : 0;
+    start = 0.0f;
+  }
+
+  offset = std::min((unsigned int)start, limit);
+  size = std::min(length, limit - offset);
+}
+
+void LSystemRenderer::CaptureRegion(int padding, unsigned int& x, unsigned int& y, unsigned int& w, unsigned int& h) const
+{
+  // Captures cover the geometry where the view puts it.
+  float middleX = m_windowWidth / 2.0f;
+  float middleY = m_windowHeight / 2.0f;
+  float minX = middleX + (m_minX - middleX) * m_view.Zoom + m_view.X;
+  float minY = middleY + (m_minY - middleY) * m_view.Zoom + m_view.Y;
+  float maxX = middleX + (m_maxX - middleX) * m_view.Zoom + m_view.X;
+  float maxY = middleY + (m_maxY - middleY) * m_view.Zoom + m_view.Y;
+
+  unsigned int width = std::abs(maxX - minX) + (2 * padding);
+  unsigned int height = std::abs(maxY - minY) + (2 * padding);
+
+  if (width > m_windowWidth)
+  {
+    x = 0;
+    w = m_windowWidth;
+  }
+  else
+  {
+    ClampSpan(minX - padding, width, m_windowWidth, x, w);
+  }
+  
+  if (height > m_windowHeight)
+  {
+    y = 0;
+    h = m_windowHeight;
+  }
+  else
+  {
+    ClampSpan(minY - padding, height, m_windowHeight, y, h);
+  }
+}
+
+bool LSystemRenderer::SaveScreenshot(const std::string& filepath, int padding)
 {
-  GLfloat lineWidthRange[2] = {0.0f, 0.0f};
-  glGetFloatv(GL_ALIASED_LINE_WIDTH_RANGE, lineWidthRange);
+  bool success = QueueScreenshot(filepath, padding);
+  FlushScreenshots();
 
-  if (m_lineWidth > lineWidthRange[1])
+  return success;
+}
+
+bool LSystemRenderer::QueueScreenshot(const std::string& filepath, int padding)
+{
+  unsigned int x, y, w, h;
+  CaptureRegion(padding, x, y, w, h);
+
+  if (!m_encoder)
   {
-    std::cerr << "Line width supplied (" << m_lineWidth << ") is outside supported range. Changing to " << lineWidthRange[1] << std::endl;
-    m_lineWidth = lineWidthRange[1];
+    m_encoder = std::make_unique<FrameEncoder>(m_config.Output);
   }
-  else if (m_lineWidth < lineWidthRange[0])
+
+  FrameEncoder* encoder = m_encoder.get();
+  return ReadPixelsAsync(x, y, w, h, [filepath, encoder](const unsigned int* pixels, unsigned int w, unsigned int h)
   {
-    std::cerr << "Line width supplied (" << m_lineWidth << ") is outside supported range. Changing to " << lineWidthRange[0] << std::endl;
-    m_lineWidth = lineWidthRange[0];
+    encoder->Submit(filepath, pixels, w, h);
+  });
+}
+
+void LSystemRenderer::FlushScreenshots()
+{
+  FlushReads();
+
+  if (m_encoder)
+  {
+    m_encoder->Wait();
   }
 
-  glLineWidth(m_lineWidth);
-  glPointSize(m_lineWidth);
+  if (m_video)
+  {
+    m_video->Wait();
+  }
+}
 
-  glBegin(GL_LINES);
-  glVertex2i(x1, y1);
-  glVertex2i(x2, y2);
-  glEnd();
+bool LSystemRenderer::OpenVideo(const std::string& target)
+{
+  std::string extension = std::filesystem::path(target).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
 
-  glBegin(GL_POINTS);
-  glVertex2i(x1, y1);
-  glVertex2i(x2, y2);
-  glEnd();
+  if ((target.empty() || target[0] != '|') && (extension == ".png" || extension == ".apng"))
+    m_video = std::make_unique<ApngWriter>(m_config.Window.Framerate, FrameEncoder::PNGOptions(m_config.Output));
+  else
+    m_video = std::make_unique<VideoWriter>(m_config.Window.Framerate);
+
+  if (!m_video->Open(target))
+  {
+    m_video.reset();
+    return false;
+  }
+
+  return true;
 }
 
-void LSystemRenderer::SetupGL(bool toScreen)
+bool LSystemRenderer::QueueVideoFrame(int padding)
 {
-  glViewport(0, 0, m_windowWidth, m_windowHeight);
+  if (!m_video)
+  {
+    return false;
+  }
 
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(0, m_windowWidth, 0, m_windowHeight, -1, 1);
+  unsigned int x, y, w, h;
+  CaptureRegion(padding, x, y, w, h);
 
-  glTranslatef(0.375f, 0.375f, 0.0f);
-    
-  glMatrixMode(GL_MODELVIEW);
+  FrameSink* video = m_video.get();
+  return ReadPixelsAsync(x, y, w, h, [video](const unsigned int* pixels, unsigned int w, unsigned int h)
+  {
+    video->Submit(pixels, w, h);
+  });
+}
 
-  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-      
-  glClear(GL_COLOR_BUFFER_BIT);
+void LSystemRenderer::CloseVideo()
+{
+  FlushReads();
+  m_video.reset();
 }
 
-void LSystemRenderer::SetupRender()
+bool LSystemRenderer::ReadPixelsAsync(unsigned int x, unsigned int y, unsigned int w, unsigned int h, PixelCallback callback)
 {
-  m_x = m_origX;
-  m_y = m_origY;
-  m_currRot = m_config.General.StartingRotation;
-  m_stateStack = std::stack<RendererState>();
+  std::vector<unsigned int> pixels((size_t)w * h);
+
+  if (!ReadPixels(x, y, w, h, pixels.data()))
+  {
+    return false;
+  }
+
+  callback(pixels.data(), w, h);
+  return true;
 }
 
-void LSystemRenderer::RenderStep(int index)
+Util::RGB LSystemRenderer::SegmentColor(const Segment& segment) const
 {
   if (m_config.General.Colorful)
   {
-    m_color.Hue = (float)index / (float)m_axiom.size();
-    
-    Util::RGB rgb = Util::HSV_To_RGB(m_color);
+    Util::HSV hsv = m_color;
+    hsv.Hue = (float)segment.Index / (float)m_geometry.Symbols;
 
-    glColor4f(rgb.Red, rgb.Green, rgb.Blue, 1.0f);
+    return Util::HSV_To_RGB(hsv);
   }
-  else
+
+  return m_config.General.Color;
+}
+
+void LSystemRenderer::SetupRender()
+{
+  if (!m_interpreted)
   {
-    glColor4f(m_config.General.Color.Red, m_config.General.Color.Green, m_config.General.Color.Blue, 1.0f);
-  }
-
-  float new_x = m_x + m_config.General.Length * cosf(m_currRot * PI / 180.0f);
-  float new_y = m_y + m_config.General.Length * sinf(m_currRot * PI / 180.0f);
-
-  LConstant c = m_axiom[index];
-
-  RendererState s;
-  switch (c.Action)
-  {
-    case ActionEnum::DRAW_FORWARD:
-      DrawLine(m_x, m_y, new_x, new_y);
-      m_x = new_x;
-      m_y = new_y;
-      break;
-    case ActionEnum::MOVE_FORWARD:
-      m_x = new_x;
-      m_y = new_y;
-      break;
-    case ActionEnum::ROTATE_CW:
-      m_currRot += m_config.General.Angle;
-      m_currRot = fmodf(m_currRot, 360.0f);
-      break;
-    case ActionEnum::ROTATE_CCW:
-      m_currRot -= m_config.General.Angle;
-      m_currRot = fmodf(m_currRot, 360.0f);
-      break;
-    case ActionEnum::PUSH_STATE:
-      s.X = m_x;
-      s.Y = m_y;
-      s.Rotation = m_currRot;
-      m_stateStack.push(s);
-      break;
-    case ActionEnum::POP_STATE:
-      s = m_stateStack.top();
-      m_stateStack.pop();
-      m_x = s.X;
-      m_y = s.Y;
-      m_currRot = s.Rotation;
-      break;
-    case ActionEnum::NO_ACTION:
-    default:
-      break;
+    Interpret();
   }
 }
 
 bool LSystemRenderer::RenderNextSteps(int steps)
 {
-  int endIndex = m_drawIndex + steps;
-  for (m_drawIndex = 0; m_drawIndex < std::min((int)m_axiom.size(), endIndex); ++m_drawIndex)
-  {
-    RenderStep(m_drawIndex);
-  }
+  m_drawIndex = std::min((int)m_axiom.size(), m_drawIndex + steps);
+
+  auto end = std::lower_bound(m_geometry.Segments.begin(), m_geometry.Segments.end(), (unsigned int)m_drawIndex,
+    [](const Segment& s, unsigned int index) { return s.Index < index; });
+  DrawSegments(0, end - m_geometry.Segments.begin());
 
   return (m_drawIndex >= m_axiom.size());
 }
 
-bool LSystemRenderer::Render()
+void LSystemRenderer::SeekSteps(int steps)
 {
-  for (m_drawIndex = 0; m_drawIndex < m_axiom.size(); ++m_drawIndex)
+  m_drawIndex = std::max(0, std::min((int)m_axiom.size(), m_drawIndex + steps));
+}
+
+bool LSystemRenderer::RenderProgressive(float milliseconds)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<float, std::milli>(milliseconds);
+  size_t total = m_geometry.Segments.size();
+
+  if (m_progressiveDrawn == 0)
+  {
+    Clear();
+  }
+
+  // At least one batch per call, so progress is made however small the
+  // budget.
+  do
+  {
+    size_t end = std::min(m_progressiveDrawn + PROGRESSIVE_BATCH, total);
+    DrawSegments(m_progressiveDrawn, end);
+    m_progressiveDrawn = end;
+  }
+  while (m_progressiveDrawn < total && std::chrono::steady_clock::now() < deadline);
+
+  if (m_progressiveDrawn < total)
   {
-    RenderStep(m_drawIndex);
+    return false;
   }
 
+  m_drawIndex = m_axiom.size();
+  return true;
+}
+
+bool LSystemRenderer::Render()
+{
+  DrawSegments(0, m_geometry.Segments.size());
+  DrawInstances();
+  m_drawIndex = m_axiom.size();
+
   return true;
-}
\ No newline at end of file
+}
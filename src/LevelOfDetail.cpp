@@ -0,0 +1,411 @@
+#include "LevelOfDetail.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+static void Grow(Geometry& geometry, float x, float y)
+{
+  if (x > geometry.MaxX) geometry.MaxX = x;
+  if (x < geometry.MinX) geometry.MinX = x;
+  if (y > geometry.MaxY) geometry.MaxY = y;
+  if (y < geometry.MinY) geometry.MinY = y;
+}
+
+LevelOfDetail::LevelOfDetail(const LSystem& system, const GeneralConfigType& config)
+  : m_system(system)
+  , m_config(config)
+  , m_culling(false)
+  , m_cullMinX(0.0f)
+  , m_cullMinY(0.0f)
+  , m_cullMaxX(0.0f)
+  , m_cullMaxY(0.0f)
+{
+}
+
+void LevelOfDetail::Cull(float minX, float minY, float maxX, float maxY)
+{
+  m_culling = true;
+  m_cullMinX = minX;
+  m_cullMinY = minY;
+  m_cullMaxX = maxX;
+  m_cullMaxY = maxY;
+}
+
+void LevelOfDetail::Uncull()
+{
+  m_culling = false;
+}
+
+float LevelOfDetail::Reach(unsigned int n)
+{
+  Pose pose = { 0.0f, 0.0f, 0.0f };
+  std::vector<Pose> stack;
+  float reach = 0.0f;
+
+  Fold(m_system.Axiom(), n, pose, stack, reach);
+  return reach;
+}
+
+bool LevelOfDetail::Interpret(unsigned int n, float length, float threshold, float x, float y, Geometry& geometry, Progress* progress)
+{
+  Walker walker = Start(n, length, threshold, x, y, geometry, progress);
+  return WalkAxiom(n, walker);
+}
+
+bool LevelOfDetail::Instance(unsigned int n, float length, float x, float y, Geometry& geometry, InstancedGeometry& instanced, Progress* progress)
+{
+  // Meshes grow and placements shrink with depth; the best depth is where
+  // their sum is least.
+  unsigned int depth = 0;
+  double least = 0.0;
+  for (unsigned int d = 1; d <= n; ++d)
+  {
+    double size = 0.0;
+    for (const LConstant& c : m_system.Constants())
+    {
+      size += Summarize(c, d).Symbols;
+    }
+
+    for (const LConstant& c : m_system.Axiom())
+    {
+      size += Summarize(c, n - d).Symbols;
+    }
+
+    if (depth == 0 || size < least)
+    {
+      depth = d;
+      least = size;
+    }
+  }
+
+  Walker walker = Start(n, length, 0.0f, x, y, geometry, progress);
+  walker.Culling = false;
+
+  instanced = InstancedGeometry();
+  instanced.Length = length;
+  instanced.IndexScale = walker.IndexScale;
+  walker.Instances = (depth > 0) ? &instanced : NULL;
+  walker.InstanceDepth = depth;
+
+  if (!WalkAxiom(n, walker))
+  {
+    return false;
+  }
+
+  std::stable_sort(instanced.Instances.begin(), instanced.Instances.end(), [](const ::Instance& a, const ::Instance& b) { return a.Mesh < b.Mesh; });
+  return true;
+}
+
+LevelOfDetail::Walker LevelOfDetail::Start(unsigned int n, float length, float threshold, float x, float y, Geometry& geometry, Progress* progress)
+{
+  double total = 0.0;
+  for (const LConstant& c : m_system.Axiom())
+  {
+    total += Summarize(c, n).Symbols;
+  }
+
+  // Segment indices count symbols of the full expansion, squeezed to fit
+  // when there are more of them than an index can hold.
+  double indexScale = (total > UINT_MAX) ? UINT_MAX / total : 1.0;
+
+  geometry = Geometry();
+  geometry.Symbols = (size_t)std::max(total * indexScale, 1.0);
+
+  Walker walker = { Turtle(m_config, length / m_config.Length), geometry, length, threshold / length, 0.0, total, indexScale, 0, progress, m_culling, NULL, 0 };
+  walker.Pen.Reset(x, y);
+  Grow(geometry, x, y);
+
+  return walker;
+}
+
+bool LevelOfDetail::WalkAxiom(unsigned int n, Walker& walker)
+{
+  for (const LConstant& c : m_system.Axiom())
+  {
+    if (!Walk(c, n, walker))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void LevelOfDetail::Place(const LConstant& c, unsigned int depth, const Summary& summary, Walker& walker)
+{
+  InstancedGeometry& instanced = *walker.Instances;
+
+  auto found = walker.Meshes.find(Key(c, depth));
+  if (found == walker.Meshes.end())
+  {
+    Geometry mesh;
+    Walker local = { Turtle(m_config, 1.0f / m_config.Length), mesh, 1.0f, 0.0f, 0.0, summary.Symbols, 1.0, 0, NULL, false, NULL, 0 };
+    local.Pen.Reset(0.0f, 0.0f, 0.0f);
+    Grow(mesh, 0.0f, 0.0f);
+    Walk(c, depth, local);
+
+    found = walker.Meshes.emplace(Key(c, depth), (unsigned int)instanced.Meshes.size()).first;
+    instanced.Meshes.push_back(std::move(mesh));
+  }
+
+  ::Instance instance;
+  instance.X = walker.Pen.X();
+  instance.Y = walker.Pen.Y();
+  instance.Rotation = walker.Pen.Rotation();
+  instance.Scale = 1.0f;
+  instance.Mesh = found->second;
+  instance.Index = (unsigned int)(walker.Done * walker.IndexScale);
+  instanced.Instances.push_back(instance);
+
+  const Box& box = Turn(instance.Mesh, instance.Rotation, walker);
+  Grow(walker.Output, instance.X + box.MinX * walker.Length, instance.Y + box.MinY * walker.Length);
+  Grow(walker.Output, instance.X + box.MaxX * walker.Length, instance.Y + box.MaxY * walker.Length);
+
+  walker.Pen.Jump(summary.End.X, summary.End.Y, summary.End.Rotation);
+  Grow(walker.Output, walker.Pen.X(), walker.Pen.Y());
+  walker.Done += summary.Symbols;
+}
+
+const LevelOfDetail::Box& LevelOfDetail::Turn(unsigned int mesh, float rotation, Walker& walker)
+{
+  // A system only turns by multiples of its angle, so the same few
+  // rotations come up again and again.
+  uint64_t key = ((uint64_t)mesh << 32) | (uint32_t)(int32_t)lroundf(rotation * 1000.0f);
+  auto found = walker.Turned.find(key);
+  if (found != walker.Turned.end())
+  {
+    return found->second;
+  }
+
+  float cosine = cosf(rotation * PI / 180.0f);
+  float sine = sinf(rotation * PI / 180.0f);
+
+  Box box = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for (const Segment& s : walker.Instances->Meshes[mesh].Segments)
+  {
+    float xs[2] = { s.X1, s.X2 };
+    float ys[2] = { s.Y1, s.Y2 };
+    for (int i = 0; i < 2; ++i)
+    {
+      float x = xs[i] * cosine - ys[i] * sine;
+      float y = xs[i] * sine + ys[i] * cosine;
+      box.MinX = std::min(box.MinX, x);
+      box.MinY = std::min(box.MinY, y);
+      box.MaxX = std::max(box.MaxX, x);
+      box.MaxY = std::max(box.MaxY, y);
+    }
+  }
+
+  return walker.Turned.emplace(key, box).first->second;
+}
+
+uint64_t LevelOfDetail::Key(const LConstant& c, unsigned int depth) const
+{
+  return ((uint64_t)(unsigned char)c.Name << 40) | ((uint64_t)c.Action << 32) | depth;
+}
+
+const LevelOfDetail::Summary& LevelOfDetail::Summarize(const LConstant& c, unsigned int depth)
+{
+  uint64_t key = Key(c, depth);
+  auto found = m_summaries.find(key);
+  if (found != m_summaries.end())
+  {
+    return found->second;
+  }
+
+  Summary summary = {};
+  summary.Balanced = true;
+
+  const std::vector<LConstant>* successor = (depth > 0) ? m_system.Successor(c) : NULL;
+  if (successor == NULL)
+  {
+    summary.Symbols = 1.0;
+
+    switch (c.Action)
+    {
+      case ActionEnum::DRAW_FORWARD:
+        summary.Draws = true;
+        summary.End.X = 1.0f;
+        summary.Reach = 1.0f;
+        break;
+      case ActionEnum::MOVE_FORWARD:
+        summary.End.X = 1.0f;
+        summary.Reach = 1.0f;
+        break;
+      case ActionEnum::ROTATE_CW:
+        summary.End.Rotation = m_config.Angle;
+        break;
+      case ActionEnum::ROTATE_CCW:
+        summary.End.Rotation = -m_config.Angle;
+        break;
+      case ActionEnum::PUSH_STATE:
+      case ActionEnum::POP_STATE:
+        summary.Balanced = false;
+        break;
+      default:
+        break;
+    }
+  }
+  else
+  {
+    for (const LConstant& child : *successor)
+    {
+      const Summary& part = Summarize(child, depth - 1);
+      summary.Symbols += part.Symbols;
+      summary.Draws = summary.Draws || part.Draws;
+    }
+
+    std::vector<Pose> stack;
+    summary.Balanced = Fold(*successor, depth - 1, summary.End, stack, summary.Reach) && stack.empty();
+  }
+
+  return m_summaries.emplace(key, summary).first->second;
+}
+
+bool LevelOfDetail::Fold(const std::vector<LConstant>& sequence, unsigned int depth, Pose& pose, std::vector<Pose>& stack, float& reach)
+{
+  for (const LConstant& c : sequence)
+  {
+    const Summary& summary = Summarize(c, depth);
+    if (summary.Balanced)
+    {
+      reach = std::max(reach, std::hypot(pose.X, pose.Y) + summary.Reach);
+
+      float cosine = cosf(pose.Rotation * PI / 180.0f);
+      float sine = sinf(pose.Rotation * PI / 180.0f);
+      pose.X += summary.End.X * cosine - summary.End.Y * sine;
+      pose.Y += summary.End.X * sine + summary.End.Y * cosine;
+      pose.Rotation = fmodf(pose.Rotation + summary.End.Rotation, 360.0f);
+      continue;
+    }
+
+    // Brackets that don't pair up within c are followed one level down,
+    // where they may pair up with their neighbours.
+    const std::vector<LConstant>* successor = (depth > 0) ? m_system.Successor(c) : NULL;
+    if (successor != NULL)
+    {
+      if (!Fold(*successor, depth - 1, pose, stack, reach))
+      {
+        return false;
+      }
+    }
+    else if (c.Action == ActionEnum::PUSH_STATE)
+    {
+      stack.push_back(pose);
+    }
+    else
+    {
+      if (stack.empty())
+      {
+        return false;
+      }
+
+      pose = stack.back();
+      stack.pop_back();
+    }
+  }
+
+  return true;
+}
+
+bool LevelOfDetail::Walk(const LConstant& c, unsigned int depth, Walker& walker)
+{
+  const Summary& summary = Summarize(c, depth);
+  const std::vector<LConstant>* successor = (depth > 0) ? m_system.Successor(c) : NULL;
+
+  if (walker.Instances != NULL && depth == walker.InstanceDepth && successor != NULL && summary.Balanced && summary.Draws)
+  {
+    Place(c, depth, summary, walker);
+    return true;
+  }
+
+  if (walker.Culling && successor != NULL && summary.Balanced)
+  {
+    // Nothing the subtree draws can be seen, so it is stepped over whole.
+    float x = walker.Pen.X();
+    float y = walker.Pen.Y();
+    float reach = summary.Reach * walker.Length;
+    if (x + reach < m_cullMinX || x - reach > m_cullMaxX || y + reach < m_cullMinY || y - reach > m_cullMaxY)
+    {
+      walker.Pen.Jump(summary.End.X, summary.End.Y, summary.End.Rotation);
+      walker.Done += summary.Symbols;
+      return true;
+    }
+  }
+
+  if (successor != NULL && !(summary.Balanced && summary.Reach < walker.Limit))
+  {
+    for (const LConstant& child : *successor)
+    {
+      if (!Walk(child, depth - 1, walker))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  if (walker.Report != NULL && walker.Steps++ % PROGRESS_INTERVAL == 0)
+  {
+    if (walker.Report->Cancelled())
+    {
+      return false;
+    }
+
+    walker.Report->Report("Interpreting", (float)(walker.Done / walker.Total));
+  }
+
+  Segment segment;
+  segment.Index = (unsigned int)(walker.Done * walker.IndexScale);
+
+  bool drew;
+  if (successor == NULL)
+  {
+    drew = walker.Pen.Step(c, segment);
+  }
+  else
+  {
+    float heading = walker.Pen.Rotation();
+    segment.X1 = walker.Pen.X();
+    segment.Y1 = walker.Pen.Y();
+
+    walker.Pen.Jump(summary.End.X, summary.End.Y, summary.End.Rotation);
+    segment.X2 = walker.Pen.X();
+    segment.Y2 = walker.Pen.Y();
+    drew = summary.Draws;
+
+    // A subtree that ends close to where it started still covers a pixel or
+    // so, which a stub one pixel long stands in for.
+    float dx = segment.X2 - segment.X1;
+    float dy = segment.Y2 - segment.Y1;
+    float length = std::hypot(dx, dy);
+    if (drew && length < 1.0f)
+    {
+      if (length > 0.0f)
+      {
+        dx /= length;
+        dy /= length;
+      }
+      else
+      {
+        dx = cosf(heading * PI / 180.0f);
+        dy = sinf(heading * PI / 180.0f);
+      }
+
+      segment.X2 = segment.X1 + dx;
+      segment.Y2 = segment.Y1 + dy;
+    }
+  }
+
+  if (drew)
+  {
+    walker.Output.Segments.push_back(segment);
+    Grow(walker.Output, segment.X2, segment.Y2);
+  }
+
+  Grow(walker.Output, walker.Pen.X(), walker.Pen.Y());
+  walker.Done += summary.Symbols;
+  return true;
+}
@@ -0,0 +1,186 @@
+#include "LineKernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define LINE_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+CapsuleLine::CapsuleLine(float x1, float y1, float x2, float y2, float width, unsigned int color)
+  : AX(x1)
+  , AY(y1)
+  , DX(x2 - x1)
+  , DY(y2 - y1)
+  , Radius(width / 2.0f)
+  , Red((color & 0xFF) / 255.0f)
+  , Green(((color >> 8) & 0xFF) / 255.0f)
+  , Blue(((color >> 16) & 0xFF) / 255.0f)
+{
+  float length2 = DX * DX + DY * DY;
+  InvLength2 = (length2 > 0.0f) ? 1.0f / length2 : 0.0f;
+}
+
+static void BlendSpanScalar(const CapsuleLine& l, float* red, float* green, float* blue, float* alpha, int count, float x, float y)
+{
+  float qy = y - l.AY;
+
+  for (int i = 0; i < count; ++i)
+  {
+    float qx = x + i - l.AX;
+
+    float t = std::min(std::max((qx * l.DX + qy * l.DY) * l.InvLength2, 0.0f), 1.0f);
+    float ex = qx - t * l.DX;
+    float ey = qy - t * l.DY;
+
+    float coverage = std::min(std::max(l.Radius + 0.5f - std::sqrt(ex * ex + ey * ey), 0.0f), 1.0f);
+    if (coverage > 0.0f)
+    {
+      red[i]   += (l.Red - red[i]) * coverage;
+      green[i] += (l.Green - green[i]) * coverage;
+      blue[i]  += (l.Blue - blue[i]) * coverage;
+      alpha[i] += (1.0f - alpha[i]) * coverage;
+    }
+  }
+}
+
+#ifdef LINE_KERNEL_X86
+
+static void BlendSpanSSE(const CapsuleLine& l, float* red, float* green, float* blue, float* alpha, int count, float x, float y)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one  = _mm_set1_ps(1.0f);
+  const __m128 ramp = _mm_set1_ps(l.Radius + 0.5f);
+  const __m128 dx   = _mm_set1_ps(l.DX);
+  const __m128 dy   = _mm_set1_ps(l.DY);
+  const __m128 inv  = _mm_set1_ps(l.InvLength2);
+  const __m128 qy   = _mm_set1_ps(y - l.AY);
+  const __m128 qyDy = _mm_mul_ps(qy, dy);
+  const __m128 cr   = _mm_set1_ps(l.Red);
+  const __m128 cg   = _mm_set1_ps(l.Green);
+  const __m128 cb   = _mm_set1_ps(l.Blue);
+
+  __m128 qx = _mm_add_ps(_mm_set1_ps(x - l.AX), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+  const __m128 step = _mm_set1_ps(4.0f);
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4, qx = _mm_add_ps(qx, step))
+  {
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(qx, dx), qyDy), inv);
+    t = _mm_min_ps(_mm_max_ps(t, zero), one);
+
+    __m128 ex = _mm_sub_ps(qx, _mm_mul_ps(t, dx));
+    __m128 ey = _mm_sub_ps(qy, _mm_mul_ps(t, dy));
+    __m128 d  = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+
+    __m128 c = _mm_min_ps(_mm_max_ps(_mm_sub_ps(ramp, d), zero), one);
+    if (_mm_movemask_ps(_mm_cmpgt_ps(c, zero)) == 0)
+    {
+      continue;
+    }
+
+    __m128 r = _mm_loadu_ps(red + i);
+    __m128 g = _mm_loadu_ps(green + i);
+    __m128 b = _mm_loadu_ps(blue + i);
+    __m128 a = _mm_loadu_ps(alpha + i);
+
+    _mm_storeu_ps(red + i,   _mm_add_ps(r, _mm_mul_ps(_mm_sub_ps(cr, r), c)));
+    _mm_storeu_ps(green + i, _mm_add_ps(g, _mm_mul_ps(_mm_sub_ps(cg, g), c)));
+    _mm_storeu_ps(blue + i,  _mm_add_ps(b, _mm_mul_ps(_mm_sub_ps(cb, b), c)));
+    _mm_storeu_ps(alpha + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(one, a), c)));
+  }
+
+  if (i < count)
+  {
+    BlendSpanScalar(l, red + i, green + i, blue + i, alpha + i, count - i, x + i, y);
+  }
+}
+
+__attribute__((target("avx2,fma")))
+static void BlendSpanAVX2(const CapsuleLine& l, float* red, float* green, float* blue, float* alpha, int count, float x, float y)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one  = _mm256_set1_ps(1.0f);
+  const __m256 ramp = _mm256_set1_ps(l.Radius + 0.5f);
+  const __m256 dx   = _mm256_set1_ps(l.DX);
+  const __m256 dy   = _mm256_set1_ps(l.DY);
+  const __m256 inv  = _mm256_set1_ps(l.InvLength2);
+  const __m256 qy   = _mm256_set1_ps(y - l.AY);
+  const __m256 qyDy = _mm256_mul_ps(qy, dy);
+  const __m256 cr   = _mm256_set1_ps(l.Red);
+  const __m256 cg   = _mm256_set1_ps(l.Green);
+  const __m256 cb   = _mm256_set1_ps(l.Blue);
+
+  __m256 qx = _mm256_add_ps(_mm256_set1_ps(x - l.AX), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+  const __m256 step = _mm256_set1_ps(8.0f);
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8, qx = _mm256_add_ps(qx, step))
+  {
+    __m256 t = _mm256_mul_ps(_mm256_fmadd_ps(qx, dx, qyDy), inv);
+    t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+
+    __m256 ex = _mm256_fnmadd_ps(t, dx, qx);
+    __m256 ey = _mm256_fnmadd_ps(t, dy, qy);
+    __m256 d  = _mm256_sqrt_ps(_mm256_fmadd_ps(ex, ex, _mm256_mul_ps(ey, ey)));
+
+    __m256 c = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(ramp, d), zero), one);
+    if (_mm256_movemask_ps(_mm256_cmp_ps(c, zero, _CMP_GT_OQ)) == 0)
+    {
+      continue;
+    }
+
+    __m256 r = _mm256_loadu_ps(red + i);
+    __m256 g = _mm256_loadu_ps(green + i);
+    __m256 b = _mm256_loadu_ps(blue + i);
+    __m256 a = _mm256_loadu_ps(alpha + i);
+
+    _mm256_storeu_ps(red + i,   _mm256_fmadd_ps(_mm256_sub_ps(cr, r), c, r));
+    _mm256_storeu_ps(green + i, _mm256_fmadd_ps(_mm256_sub_ps(cg, g), c, g));
+    _mm256_storeu_ps(blue + i,  _mm256_fmadd_ps(_mm256_sub_ps(cb, b), c, b));
+    _mm256_storeu_ps(alpha + i, _mm256_fmadd_ps(_mm256_sub_ps(one, a), c, a));
+  }
+
+  if (i < count)
+  {
+    BlendSpanSSE(l, red + i, green + i, blue + i, alpha + i, count - i, x + i, y);
+  }
+}
+
+#endif
+
+typedef void (*BlendSpanFunction)(const CapsuleLine&, float*, float*, float*, float*, int, float, float);
+
+struct KernelChoice
+{
+  BlendSpanFunction Function;
+  const char* Name;
+};
+
+static KernelChoice ChooseKernel()
+{
+#ifdef LINE_KERNEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  {
+    return { BlendSpanAVX2, "AVX2" };
+  }
+
+  return { BlendSpanSSE, "SSE" };
+#else
+  return { BlendSpanScalar, "scalar" };
+#endif
+}
+
+static const KernelChoice s_kernel = ChooseKernel();
+
+void LineKernel::BlendSpan(const CapsuleLine& line, float* red, float* green, float* blue, float* alpha, int count, float x, float y)
+{
+  s_kernel.Function(line, red, green, blue, alpha, count, x, y);
+}
+
+const char* LineKernel::InstructionSet()
+{
+  return s_kernel.Name;
+}
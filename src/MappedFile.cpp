@@ -0,0 +1,207 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+  : m_data(NULL)
+  , m_size(0)
+  , m_file(INVALID_HANDLE_VALUE)
+  , m_mapping(NULL)
+{
+}
+
+bool MappedFile::Create(const std::string& path, size_t size)
+{
+  Close(m_size);
+
+  m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m_file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  // Creating the mapping extends the file to its full size.
+  m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+  if (m_mapping != NULL)
+  {
+    m_data = (unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size);
+  }
+
+  if (m_data == NULL)
+  {
+    if (m_mapping != NULL) CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_mapping = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+    return false;
+  }
+
+  m_size = size;
+  return true;
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+  Close(m_size);
+
+  m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m_file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(m_file, &size) && size.QuadPart > 0)
+  {
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping != NULL)
+    {
+      m_data = (unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+  }
+
+  if (m_data == NULL)
+  {
+    if (m_mapping != NULL) CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_mapping = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+    return false;
+  }
+
+  m_size = size.QuadPart;
+  return true;
+}
+
+bool MappedFile::Close(size_t size)
+{
+  if (m_file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  UnmapViewOfFile(m_data);
+  CloseHandle(m_mapping);
+
+  bool success = true;
+  if (size < m_size)
+  {
+    LARGE_INTEGER end;
+    end.QuadPart = size;
+    success = SetFilePointerEx(m_file, end, NULL, FILE_BEGIN) && SetEndOfFile(m_file);
+  }
+  CloseHandle(m_file);
+
+  m_data = NULL;
+  m_mapping = NULL;
+  m_file = INVALID_HANDLE_VALUE;
+  m_size = 0;
+  return success;
+}
+
+#else
+
+MappedFile::MappedFile()
+  : m_data(NULL)
+  , m_size(0)
+  , m_fd(-1)
+{
+}
+
+bool MappedFile::Create(const std::string& path, size_t size)
+{
+  Close(m_size);
+
+  m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (m_fd < 0)
+  {
+    return false;
+  }
+
+  // Reserve the blocks up front so stores into the mapping can't fault on a
+  // full disk; fall back to a sparse file where that isn't supported.
+  bool sized = (size == 0);
+  if (!sized)
+  {
+    sized = (posix_fallocate(m_fd, 0, size) == 0) || (ftruncate(m_fd, size) == 0);
+  }
+
+  void* data = sized && size ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0) : MAP_FAILED;
+  if (data == MAP_FAILED)
+  {
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+
+  m_data = (unsigned char*)data;
+  m_size = size;
+  return true;
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+  Close(m_size);
+
+  m_fd = open(path.c_str(), O_RDONLY);
+  if (m_fd < 0)
+  {
+    return false;
+  }
+
+  struct stat info;
+  void* data = MAP_FAILED;
+  if (fstat(m_fd, &info) == 0 && info.st_size > 0)
+  {
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+  }
+
+  if (data == MAP_FAILED)
+  {
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+
+  m_data = (unsigned char*)data;
+  m_size = info.st_size;
+  return true;
+}
+
+bool MappedFile::Close(size_t size)
+{
+  if (m_fd < 0)
+  {
+    return false;
+  }
+
+  munmap(m_data, m_size);
+
+  bool success = true;
+  if (size < m_size)
+  {
+    success = (ftruncate(m_fd, size) == 0);
+  }
+  close(m_fd);
+
+  m_data = NULL;
+  m_fd = -1;
+  m_size = 0;
+  return success;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  Close(m_size);
+}
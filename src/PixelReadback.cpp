@@ -0,0 +1,144 @@
+#include "PixelReadback.h"
+
+#include "glew.h"
+#include "GL/GL.h"
+#include <iostream>
+#include <vector>
+
+PixelReadback::PixelReadback(size_t ringSize)
+  : m_slots(ringSize)
+  , m_oldest(0)
+  , m_pending(0)
+  , m_failures(0)
+{
+  for (auto& slot : m_slots)
+  {
+    glGenBuffers(1, &slot.Buffer);
+    slot.Capacity = 0;
+    slot.Fence = nullptr;
+  }
+}
+
+PixelReadback::~PixelReadback()
+{
+  Poll(true);
+
+  for (auto& slot : m_slots)
+  {
+    glDeleteBuffers(1, &slot.Buffer);
+  }
+}
+
+bool PixelReadback::Supported()
+{
+  return (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object) && (GLEW_VERSION_3_2 || GLEW_ARB_sync);
+}
+
+bool PixelReadback::Queue(unsigned int x, unsigned int y, unsigned int w, unsigned int h, PixelCallback callback)
+{
+  Poll(false);
+
+  if (m_pending == m_slots.size())
+  {
+    Complete(m_slots[m_oldest]);
+  }
+
+  Slot& slot = m_slots[(m_oldest + m_pending) % m_slots.size()];
+  size_t size = (size_t)w * h * sizeof(unsigned int);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Buffer);
+  if (slot.Capacity < size)
+  {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    slot.Capacity = size;
+  }
+
+  glReadPixels(x, y, w, h, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  GLenum error = glGetError();
+  if (error != GL_NO_ERROR)
+  {
+    std::cerr << "glReadPixels error: " << error << std::endl;
+    return false;
+  }
+
+  slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.Width = w;
+  slot.Height = h;
+  slot.Callback = std::move(callback);
+  ++m_pending;
+
+  // Make sure the read is actually submitted, otherwise polling the fence
+  // later could wait on commands the driver is still holding.
+  glFlush();
+  return true;
+}
+
+void PixelReadback::Poll(bool wait)
+{
+  while (m_pending > 0 && Ready(m_slots[m_oldest], wait))
+  {
+    Complete(m_slots[m_oldest]);
+  }
+}
+
+size_t PixelReadback::TakeFailures()
+{
+  size_t failures = m_failures;
+  m_failures = 0;
+  return failures;
+}
+
+bool PixelReadback::Ready(Slot& slot, bool wait)
+{
+  if (wait)
+  {
+    return true;
+  }
+
+  GLenum status = glClientWaitSync((GLsync)slot.Fence, 0, 0);
+  return (status != GL_TIMEOUT_EXPIRED);
+}
+
+void PixelReadback::Complete(Slot& slot)
+{
+  const GLuint64 second = 1000000000;
+  while (glClientWaitSync((GLsync)slot.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, second) == GL_TIMEOUT_EXPIRED)
+  {
+  }
+  glDeleteSync((GLsync)slot.Fence);
+  slot.Fence = nullptr;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Buffer);
+  const unsigned int* pixels = (const unsigned int*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (pixels)
+  {
+    slot.Callback(pixels, slot.Width, slot.Height);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  else
+  {
+    // Copy the pixels out instead, so that the frame isn't lost.
+    std::cerr << "Failed to map pixel buffer. Error: " << glGetError() << ". Copying it instead." << std::endl;
+
+    std::vector<unsigned int> copy((size_t)slot.Width * slot.Height);
+    glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, copy.size() * sizeof(unsigned int), copy.data());
+
+    GLenum error = glGetError();
+    if (error == GL_NO_ERROR)
+    {
+      slot.Callback(copy.data(), slot.Width, slot.Height);
+    }
+    else
+    {
+      std::cerr << "Failed to copy pixel buffer. Error: " << error << std::endl;
+      ++m_failures;
+    }
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.Callback = nullptr;
+  m_oldest = (m_oldest + 1) % m_slots.size();
+  --m_pending;
+}
@@ -0,0 +1,128 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threads)
+  : m_active(0)
+  , m_stopping(false)
+{
+  if (threads == 0)
+  {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  for (unsigned int i = 0; i < threads; ++i)
+  {
+    m_threads.emplace_back(&ThreadPool::Worker, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_taskAvailable.notify_all();
+
+  for (auto& t : m_threads)
+  {
+    t.join();
+  }
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push(std::move(task));
+  }
+  m_taskAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_tasksDone.wait(lock, [this] { return m_tasks.empty() && m_active == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  struct Shared
+  {
+    std::atomic<size_t> Next{0};
+    std::atomic<size_t> Finished{0};
+    std::mutex Mutex;
+    std::condition_variable Done;
+  };
+  auto shared = std::make_shared<Shared>();
+
+  auto work = [shared, count, &fn]()
+  {
+    size_t i;
+    while ((i = shared->Next.fetch_add(1)) < count)
+    {
+      fn(i);
+      if (shared->Finished.fetch_add(1) + 1 == count)
+      {
+        std::lock_guard<std::mutex> lock(shared->Mutex);
+        shared->Done.notify_all();
+      }
+    }
+  };
+
+  size_t helpers = std::min<size_t>(m_threads.size(), count - 1);
+  for (size_t i = 0; i < helpers; ++i)
+  {
+    Enqueue(work);
+  }
+
+  work();
+
+  std::unique_lock<std::mutex> lock(shared->Mutex);
+  shared->Done.wait(lock, [&] { return shared->Finished.load() == count; });
+}
+
+unsigned int ThreadPool::Size() const
+{
+  return m_threads.size();
+}
+
+void ThreadPool::Worker()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_taskAvailable.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+
+      if (m_stopping && m_tasks.empty())
+      {
+        return;
+      }
+
+      task = std::move(m_tasks.front());
+      m_tasks.pop();
+      ++m_active;
+    }
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_active;
+      if (m_tasks.empty() && m_active == 0)
+      {
+        m_tasksDone.notify_all();
+      }
+    }
+  }
+}
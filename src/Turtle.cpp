@@ -0,0 +1,176 @@
+#include "Turtle.h"
+
+#include <cmath>
+#include <limits>
+
+Geometry::Geometry()
+  : Symbols(0)
+  , MinX(std::numeric_limits<float>::max())
+  , MinY(std::numeric_limits<float>::max())
+  , MaxX(std::numeric_limits<float>::lowest())
+  , MaxY(std::numeric_limits<float>::lowest())
+{
+}
+
+Turtle::Turtle(const GeneralConfigType& config, float scale)
+  : m_length(config.Length * scale)
+  , m_angle(config.Angle)
+  , m_startingRotation(config.StartingRotation)
+  , m_x(0.0f)
+  , m_y(0.0f)
+  , m_currRot(config.StartingRotation)
+{
+}
+
+void Turtle::Reset(float x, float y)
+{
+  Reset(x, y, m_startingRotation);
+}
+
+void Turtle::Reset(float x, float y, float rotation)
+{
+  m_x = x;
+  m_y = y;
+  m_currRot = rotation;
+  m_stateStack = std::stack<RendererState>();
+}
+
+bool Turtle::Interpret(const std::vector<LConstant>& axiom, Geometry& geometry, Progress* progress)
+{
+  return Interpret(axiom, 0, axiom.size(), geometry, progress);
+}
+
+bool Turtle::Interpret(const std::vector<LConstant>& axiom, size_t begin, size_t end, Geometry& geometry, Progress* progress,
+  std::vector<Checkpoint>* checkpoints, size_t interval)
+{
+  geometry.Symbols += end - begin;
+
+  auto grow = [&geometry](float x, float y)
+  {
+    if (x > geometry.MaxX) geometry.MaxX = x;
+    if (x < geometry.MinX) geometry.MinX = x;
+    if (y > geometry.MaxY) geometry.MaxY = y;
+    if (y < geometry.MinY) geometry.MinY = y;
+  };
+
+  grow(m_x, m_y);
+
+  Segment s;
+  for (size_t i = begin; i < end; ++i)
+  {
+    if (progress != NULL && (i - begin) % PROGRESS_INTERVAL == 0)
+    {
+      if (progress->Cancelled())
+      {
+        return false;
+      }
+
+      progress->Report("Interpreting", (float)i / axiom.size());
+    }
+
+    if (checkpoints != NULL && i % interval == 0)
+    {
+      checkpoints->push_back({ i, { m_x, m_y, m_currRot }, m_stateStack });
+    }
+
+    if (Step(axiom[i], s))
+    {
+      s.Index = (unsigned int)i;
+      geometry.Segments.push_back(s);
+    }
+
+    grow(m_x, m_y);
+  }
+
+  return true;
+}
+
+void Turtle::Restore(const Checkpoint& checkpoint, float x, float y)
+{
+  m_x = checkpoint.State.X + x;
+  m_y = checkpoint.State.Y + y;
+  m_currRot = checkpoint.State.Rotation;
+  m_stateStack = checkpoint.Stack;
+
+  if (x != 0.0f || y != 0.0f)
+  {
+    std::vector<RendererState> states;
+    for (; !m_stateStack.empty(); m_stateStack.pop())
+    {
+      states.push_back(m_stateStack.top());
+    }
+
+    for (auto state = states.rbegin(); state != states.rend(); ++state)
+    {
+      m_stateStack.push({ state->X + x, state->Y + y, state->Rotation });
+    }
+  }
+}
+
+bool Turtle::Step(const LConstant& c, Segment& segment)
+{
+  bool drew = false;
+
+  // Only moves need the heading's direction.
+  float new_x = m_x;
+  float new_y = m_y;
+  if (c.Action == ActionEnum::DRAW_FORWARD || c.Action == ActionEnum::MOVE_FORWARD)
+  {
+    new_x = m_x + m_length * cosf(m_currRot * PI / 180.0f);
+    new_y = m_y + m_length * sinf(m_currRot * PI / 180.0f);
+  }
+
+  RendererState s;
+  switch (c.Action)
+  {
+    case ActionEnum::DRAW_FORWARD:
+      segment.X1 = m_x;
+      segment.Y1 = m_y;
+      segment.X2 = new_x;
+      segment.Y2 = new_y;
+      m_x = new_x;
+      m_y = new_y;
+      drew = true;
+      break;
+    case ActionEnum::MOVE_FORWARD:
+      m_x = new_x;
+      m_y = new_y;
+      break;
+    case ActionEnum::ROTATE_CW:
+      m_currRot += m_angle;
+      m_currRot = fmodf(m_currRot, 360.0f);
+      break;
+    case ActionEnum::ROTATE_CCW:
+      m_currRot -= m_angle;
+      m_currRot = fmodf(m_currRot, 360.0f);
+      break;
+    case ActionEnum::PUSH_STATE:
+      s.X = m_x;
+      s.Y = m_y;
+      s.Rotation = m_currRot;
+      m_stateStack.push(s);
+      break;
+    case ActionEnum::POP_STATE:
+      s = m_stateStack.top();
+      m_stateStack.pop();
+      m_x = s.X;
+      m_y = s.Y;
+      m_currRot = s.Rotation;
+      break;
+    case ActionEnum::NO_ACTION:
+    default:
+      break;
+  }
+
+  return drew;
+}
+
+void Turtle::Jump(float x, float y, float rotation)
+{
+  float c = cosf(m_currRot * PI / 180.0f);
+  float s = sinf(m_currRot * PI / 180.0f);
+
+  m_x += m_length * (x * c - y * s);
+  m_y += m_length * (x * s + y * c);
+  m_currRot = fmodf(m_currRot + rotation, 360.0f);
+}
@@ -0,0 +1,170 @@
+#include "VideoWriter.h"
+
+#include "ColorConvert.h"
+
+#include <iostream>
+#include <memory>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE_MODE "wb"
+#else
+#include <csignal>
+#define PIPE_WRITE_MODE "w"
+#endif
+
+VideoWriter::VideoWriter(int framerate, size_t queueDepth)
+  : m_framerate(framerate)
+  , m_file(NULL)
+  , m_pipe(false)
+  , m_failed(false)
+  , m_width(0)
+  , m_height(0)
+  , m_writer(1)
+  , m_queueDepth(queueDepth)
+  , m_inFlight(0)
+{
+}
+
+VideoWriter::~VideoWriter()
+{
+  Close();
+}
+
+bool VideoWriter::Open(const std::string& target)
+{
+  Close();
+
+  m_pipe = (!target.empty() && target[0] == '|');
+  if (m_pipe)
+  {
+#ifndef _WIN32
+    // An encoder that exits early should end the video, not the program.
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    m_file = popen(target.c_str() + 1, PIPE_WRITE_MODE);
+  }
+  else
+  {
+    m_file = fopen(target.c_str(), "wb");
+  }
+
+  if (m_file == NULL)
+  {
+    std::cerr << "Failed to open video output \"" << target << "\"." << std::endl;
+    return false;
+  }
+
+  std::cout << "Streaming video to " << (m_pipe ? target.substr(1) : target) << " (" << ColorConvert::InstructionSet() << " color conversion)." << std::endl;
+
+  m_failed = false;
+  m_width = 0;
+  m_height = 0;
+  return true;
+}
+
+void VideoWriter::Close()
+{
+  Wait();
+
+  if (m_file == NULL)
+  {
+    return;
+  }
+
+  if (m_pipe)
+  {
+    int status = pclose(m_file);
+    if (status != 0)
+    {
+      std::cerr << "Video encoder exited with status " << status << "." << std::endl;
+    }
+  }
+  else
+  {
+    fclose(m_file);
+  }
+
+  m_file = NULL;
+}
+
+void VideoWriter::Submit(const unsigned int* pixels, unsigned int w, unsigned int h)
+{
+  if (m_file == NULL || w == 0 || h == 0)
+  {
+    return;
+  }
+
+  std::vector<unsigned char> frame;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_slotFree.wait(lock, [this] { return m_inFlight < m_queueDepth; });
+    ++m_inFlight;
+
+    if (m_width == 0)
+    {
+      m_width = (w + 1) & ~1u;
+      m_height = (h + 1) & ~1u;
+
+      // The header goes out before any frame can be queued behind it.
+      if (fprintf(m_file, "YUV4MPEG2 W%u H%u F%d:1 Ip A1:1 C420jpeg\n", m_width, m_height, m_framerate) < 0)
+      {
+        m_failed = true;
+      }
+    }
+
+    if (!m_freeBuffers.empty())
+    {
+      frame = std::move(m_freeBuffers.back());
+      m_freeBuffers.pop_back();
+    }
+  }
+
+  size_t lumaSize = (size_t)m_width * m_height;
+  frame.resize(lumaSize + lumaSize / 2);
+
+  unsigned char* y = frame.data();
+  unsigned char* u = y + lumaSize;
+  unsigned char* v = u + lumaSize / 4;
+  ColorConvert::RGBAToI420(pixels, w, h, m_width, m_height, y, u, v);
+
+  auto shared = std::make_shared<std::vector<unsigned char>>(std::move(frame));
+  m_writer.Enqueue([this, shared]()
+  {
+    WriteFrame(*shared);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_freeBuffers.push_back(std::move(*shared));
+      --m_inFlight;
+    }
+    m_slotFree.notify_one();
+  });
+}
+
+void VideoWriter::Wait()
+{
+  m_writer.Wait();
+
+  if (m_file != NULL)
+  {
+    fflush(m_file);
+  }
+}
+
+void VideoWriter::WriteFrame(const std::vector<unsigned char>& frame)
+{
+  if (m_failed)
+  {
+    return;
+  }
+
+  static const char marker[] = "FRAME\n";
+  if (fwrite(marker, 1, sizeof(marker) - 1, m_file) != sizeof(marker) - 1
+    || fwrite(frame.data(), 1, frame.size(), m_file) != frame.size())
+  {
+    std::cerr << "Failed to write video frame; dropping the rest of the video." << std::endl;
+    m_failed = true;
+  }
+}
@@ -11,9 +11,58 @@
 #include "INIReader.h"
 #include "LSystem.h"
 #include "LSystemRenderer.h"
+#include "GLRenderer.h"
+#include "CpuRenderer.h"
+#include "HeadlessContext.h"
 #include "ConfigParser.h"
+#include "BackgroundTask.h"
+#include "ConfigWatcher.h"
+#include "ExpansionCache.h"
+#include "ImageWriter.h"
 
-bool HandleEvents(bool& recalc, bool& capture)
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+// Zoom for each notch of the mouse wheel.
+#define ZOOM_STEP 1.25f
+
+// Share of the window an image fitted to it spans.
+#define FIT_FILL 0.9f
+
+// Mouse input since the last frame, in window coordinates with y down.
+struct Navigation
+{
+  // Factor to zoom by about (AtX, AtY).
+  float Zoom;
+  int AtX;
+  int AtY;
+
+  // Distance dragged.
+  int PanX;
+  int PanY;
+
+  bool Reset;
+  bool Fit;
+
+  Navigation() : Zoom(1.0f), AtX(0), AtY(0), PanX(0), PanY(0), Reset(false), Fit(false) {}
+
+  bool Moved() const { return Zoom != 1.0f || PanX != 0 || PanY != 0 || Reset || Fit; }
+};
+
+// The view that shows geometry walked for drawn as view would have.
+View Relative(const View& view, const View& drawn)
+{
+  View relative;
+  relative.Zoom = view.Zoom / drawn.Zoom;
+  relative.X = view.X - drawn.X * relative.Zoom;
+  relative.Y = view.Y - drawn.Y * relative.Zoom;
+  return relative;
+}
+
+bool HandleEvents(bool& recalc, bool& capture, int& generationStep, int& scrub, Navigation& navigation)
 {
   bool output = false;
   SDL_Event event;
@@ -38,10 +87,42 @@ bool HandleEvents(bool& recalc, bool& capture)
           case SDLK_F5:
             recalc = true;
             break;
+          case SDLK_PAGEUP:
+            ++generationStep;
+            break;
+          case SDLK_PAGEDOWN:
+            --generationStep;
+            break;
+          case SDLK_HOME:
+            navigation.Reset = true;
+            break;
+          case SDLK_f:
+            navigation.Fit = true;
+            break;
+          case SDLK_LEFT:
+            --scrub;
+            break;
+          case SDLK_RIGHT:
+            ++scrub;
+            break;
           default:
             break;
         }
         break;
+      case SDL_MOUSEWHEEL:
+        {
+          int notches = (event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED) ? -event.wheel.y : event.wheel.y;
+          navigation.Zoom *= std::pow(ZOOM_STEP, (float)notches);
+          SDL_GetMouseState(&navigation.AtX, &navigation.AtY);
+        }
+        break;
+      case SDL_MOUSEMOTION:
+        if (event.motion.state & SDL_BUTTON_LMASK)
+        {
+          navigation.PanX += event.motion.xrel;
+          navigation.PanY += event.motion.yrel;
+        }
+        break;
       case SDL_KEYUP:
         switch (event.key.keysym.sym)
         {
@@ -105,7 +186,8 @@ bool InitSDL(SDL_Window *&window, SDL_GLContext& gl, const ConfigurationType& co
     return false;
   }
 
-  status = SDL_GL_SetSwapInterval(1);
+  // Only pace to the display when there is one to look at.
+  status = SDL_GL_SetSwapInterval(config.Window.Display ? 1 : 0);
   if (status != 0)
   {
     std::cerr << "Failed to set swap interval. Error: " << SDL_GetError() << std::endl;
@@ -127,6 +209,309 @@ bool InitSDL(SDL_Window *&window, SDL_GLContext& gl, const ConfigurationType& co
   return true;
 }
 
+bool InitHeadless(HeadlessContext& context, ConfigurationType& config)
+{
+  if (config.Window.Display)
+  {
+    std::cout << "Headless rendering has no window. Rendering without display." << std::endl;
+    config.Window.Display = false;
+  }
+
+  std::cout << "Creating headless GL context for a " << config.Window.Width << "x" << config.Window.Height << " framebuffer" << std::endl;
+  return context.Create();
+}
+
+bool InitGLEW()
+{
+  glewExperimental = GL_TRUE;
+  GLenum status = glewInit();
+
+  // A headless context has no GLX display, but the GL entry points are
+  // loaded before GLEW goes looking for one.
+  if (status != GLEW_OK && status != GLEW_ERROR_NO_GLX_DISPLAY)
+  {
+    std::cerr << "Failed to init GLEW. Error: " << glewGetErrorString(status) << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+std::vector<LConstant> GenerateAxiom(LSystem& lSystem, ExpansionCache& cache, const ConfigurationType& config, uint64_t& key, Progress* progress = NULL)
+{
+  key = ExpansionCache::AxiomKey(config.System, config.General.Generation);
+
+  std::vector<LConstant> axiom;
+  if (cache.LoadAxiom(key, lSystem.Constants(), axiom))
+  {
+    std::cout << "Loaded axiom from cache." << std::endl;
+    return axiom;
+  }
+
+  // Without a window nothing steps back through generations, so the axiom
+  // is handed over rather than also kept on the ladder.
+  if (config.Window.Display)
+    axiom = lSystem.GenerateNthAxiom(config.General.Generation, progress);
+  else
+    axiom = lSystem.ReleaseNthAxiom(config.General.Generation, progress);
+
+  if (progress == NULL || !progress->Cancelled())
+  {
+    cache.StoreAxiom(key, axiom);
+  }
+  return axiom;
+}
+
+// A scene places many copies of a few variants of the system in one still
+// image, drawn at once.
+bool UseScene(const ConfigurationType& config)
+{
+  return config.Scene.Count > 0 && !config.General.Animate && config.General.FrameBudget <= 0.0f;
+}
+
+// Level of detail stands in for expansion when drawing still images of
+// systems whose every symbol always expands the same way.
+bool UseLevelOfDetail(const ConfigurationType& config, const LSystem& lSystem)
+{
+  return config.General.Lod > 0.0f && !config.General.Animate && lSystem.Deterministic() && !UseScene(config);
+}
+
+// Instancing draws each repeated subtree of such a system once and places
+// it everywhere else, for backends that can draw instances.
+bool UseInstancing(const ConfigurationType& config, const LSystem& lSystem, bool supported)
+{
+  return supported && config.General.Instancing && config.General.Lod <= 0.0f && !config.General.Animate && config.General.FrameBudget <= 0.0f && lSystem.Deterministic() && !UseScene(config);
+}
+
+// Largest side of the axiom's bounds as drawn with the configured length.
+float Extent(const GeneralConfigType& general, const std::vector<LConstant>& axiom)
+{
+  Turtle turtle(general);
+  turtle.Reset(0.0f, 0.0f);
+
+  Geometry geometry;
+  turtle.Interpret(axiom, geometry);
+  return std::max(geometry.MaxX - geometry.MinX, geometry.MaxY - geometry.MinY);
+}
+
+void ShowProgress(SDL_Window* window, const BackgroundTask& task)
+{
+  static int shownPercent = -1;
+  static std::string shownStage;
+
+  std::string stage = task.Running() ? task.Status().Stage() : "";
+  int percent = task.Running() ? (int)(task.Status().Fraction() * 100.0f) : -1;
+  if (window == NULL || (percent == shownPercent && stage == shownStage))
+  {
+    return;
+  }
+
+  shownPercent = percent;
+  shownStage = stage;
+
+  std::string title = "Lindenmayer System";
+  if (percent >= 0)
+  {
+    title += " - " + (stage.empty() ? std::string("Working") : stage) + " " + std::to_string(percent) + "%";
+  }
+  SDL_SetWindowTitle(window, title.c_str());
+}
+
+// Draws count variants of a system with weighted rules, one seed each, into
+// numbered copies of outputFile or a single atlas. Every variant expands at
+// once across a pool of threads before any is drawn.
+void RenderVariants(LSystemRenderer& renderer, const LSystem& lSystem, const ConfigurationType& config, unsigned int count, bool atlas, const std::string& outputFile)
+{
+  if (lSystem.Deterministic())
+  {
+    std::cout << "Every variant of a system without weighted rules is the same. Drawing one." << std::endl;
+    count = 1;
+  }
+
+  // Variants follow on from the configured seed, so any of them can be
+  // drawn again by setting its seed.
+  unsigned int seed = (config.System.Seed != 0) ? config.System.Seed : std::random_device()();
+
+  ThreadPool pool(config.Window.Threads);
+  std::cout << "Expanding " << count << " variants of generation " << config.General.Generation << " on " << pool.Size() << " threads." << std::endl;
+
+  std::vector<Geometry> variants;
+  renderer.PrepareVariants(lSystem, config.General.Generation, seed, count, 1.0f, &pool, variants, NULL);
+
+  std::filesystem::path filepath(outputFile);
+  std::filesystem::path folder = filepath.parent_path();
+  std::filesystem::path name = filepath.stem();
+  std::filesystem::path extension = filepath.extension();
+  if (!folder.empty()) std::filesystem::create_directories(folder);
+
+  auto draw = [&renderer]()
+  {
+    renderer.Clear();
+    renderer.SetupRender();
+    renderer.Render();
+    renderer.Present();
+  };
+
+  if (atlas)
+  {
+    Geometry layout;
+    InstancedGeometry instances;
+    renderer.PrepareAtlas(variants, layout, instances);
+    renderer.Adopt(layout, 0.0f, 0.0f, 0);
+    renderer.AdoptInstances(instances);
+    draw();
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      std::cout << "Variant " << (i + 1) << " has seed " << (seed + i) << "." << std::endl;
+    }
+
+    renderer.QueueScreenshot(outputFile, 0);
+  }
+  else
+  {
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      float x, y;
+      renderer.Position(variants[i], x, y);
+      renderer.Adopt(variants[i], x, y, 0);
+      draw();
+
+      std::filesystem::path variantName(name.string() + "_" + std::to_string(i + 1) + extension.string());
+      std::filesystem::path resultant = folder / variantName;
+      std::cout << "Variant " << (i + 1) << " has seed " << (seed + i) << ", saving to " << resultant.string() << "." << std::endl;
+
+      renderer.QueueScreenshot(resultant.string(), config.General.Padding);
+    }
+  }
+
+  renderer.FlushScreenshots();
+}
+
+// Draws every frame of the configured sweep from the one expanded axiom.
+// A batch of frames is interpreted at once across a pool of threads while
+// the batch before it is drawn, and each frame is queued to the encoders as
+// soon as it is drawn.
+void RenderSweep(LSystemRenderer& renderer, const std::vector<LConstant>& axiom, const ConfigurationType& config, bool video,
+  const std::filesystem::path& folder, const std::string& extension)
+{
+  const SweepConfigType& sweep = config.Sweep;
+
+  ThreadPool pool(config.Window.Threads);
+  std::cout << "Sweeping " << sweep.Parameter << " from " << sweep.Start << " to " << sweep.End << " over " << sweep.Frames << " frames on " << pool.Size() << " threads." << std::endl;
+
+  if (!video) std::filesystem::create_directories(folder);
+
+  struct Frame
+  {
+    Geometry Layout;
+    float X;
+    float Y;
+  };
+
+  unsigned int frames = sweep.Frames;
+  unsigned int batchSize = pool.Size();
+  std::vector<Frame> current(batchSize);
+  std::vector<Frame> next(batchSize);
+
+  auto prepare = [&](std::vector<Frame>& batch, unsigned int first)
+  {
+    pool.ParallelFor(std::min(batchSize, frames - first), [&](size_t i)
+    {
+      renderer.PrepareSweep(axiom, first + i, batch[i].Layout, batch[i].X, batch[i].Y, NULL);
+    });
+  };
+
+  prepare(current, 0);
+  for (unsigned int first = 0; first < frames; first += batchSize)
+  {
+    std::thread ahead;
+    if (first + batchSize < frames)
+    {
+      ahead = std::thread(prepare, std::ref(next), first + batchSize);
+    }
+
+    for (unsigned int i = 0; i < std::min(batchSize, frames - first); ++i)
+    {
+      // Every frame is captured whole, so that they all have the same size
+      // while each is centred on its own.
+      Geometry& layout = current[i].Layout;
+      layout.MinX = 0.0f;
+      layout.MinY = 0.0f;
+      layout.MaxX = (float)config.Window.Width;
+      layout.MaxY = (float)config.Window.Height;
+
+      renderer.Adopt(layout, current[i].X, current[i].Y, 0);
+      renderer.Clear();
+      renderer.SetupRender();
+      renderer.Render();
+      renderer.Present();
+
+      if (video)
+      {
+        renderer.QueueVideoFrame(0);
+      }
+      else
+      {
+        std::filesystem::path filename(std::to_string(first + i + 1) + extension);
+        renderer.QueueScreenshot((folder / filename).string(), 0);
+      }
+    }
+
+    if (ahead.joinable()) ahead.join();
+    current.swap(next);
+  }
+
+  renderer.FlushScreenshots();
+  std::cout << "Finished writing " << frames << " frames." << std::endl;
+}
+
+// Draws generations first to last into numbered copies of outputFile, each
+// centred on its own. Each generation is expanded from the one before on
+// the same ladder, on a helper thread while the one before is drawn and
+// encoded. axiom is the renderer's, and holds the last generation after.
+void RenderGenerations(LSystemRenderer& renderer, LSystem& lSystem, std::vector<LConstant>& axiom, const ConfigurationType& config,
+  unsigned int first, unsigned int last, const std::string& outputFile)
+{
+  std::cout << "Rendering generations " << first << " to " << last << "." << std::endl;
+
+  std::filesystem::path filepath(outputFile);
+  std::filesystem::path folder = filepath.parent_path();
+  std::filesystem::path name = filepath.stem();
+  std::filesystem::path extension = filepath.extension();
+  if (!folder.empty()) std::filesystem::create_directories(folder);
+
+  std::vector<LConstant> next = lSystem.GenerateNthAxiom(first);
+  for (unsigned int generation = first; generation <= last; ++generation)
+  {
+    axiom.swap(next);
+
+    std::thread ahead;
+    if (generation < last)
+    {
+      ahead = std::thread([&lSystem, &next, generation]() { next = lSystem.GenerateNthAxiom(generation + 1); });
+    }
+
+    std::cout << "Generation " << generation << " axiom. Length=" << axiom.size() << "." << std::endl;
+
+    Geometry layout;
+    float x, y;
+    renderer.Prepare(axiom, 0, layout, x, y, NULL);
+    renderer.Adopt(layout, x, y, 0);
+    renderer.Clear();
+    renderer.SetupRender();
+    renderer.Render();
+    renderer.Present();
+
+    std::filesystem::path generationName(name.string() + "_" + std::to_string(generation) + extension.string());
+    renderer.QueueScreenshot((folder / generationName).string(), config.General.Padding);
+
+    if (ahead.joinable()) ahead.join();
+  }
+
+  renderer.FlushScreenshots();
+}
+
 int main(int argc, char** argv)
 {
   // RedirectLog();
@@ -134,8 +519,18 @@ int main(int argc, char** argv)
   std::string iniFile = "example.ini";
   std::string outputFile = "lsystem.png";
   std::string animationFolder = "./animation/";
+  std::string backend = "";
+  std::string videoTarget = "";
+  bool headless = false;
   bool saveFinal = false;
   bool allFrames = false;
+  bool saveVideo = false;
+  unsigned int variants = 0;
+  bool atlas = false;
+  int firstGeneration = -1;
+  int lastGeneration = -1;
+  int firstFrame = 0;
+  int lastFrame = 0;
 
   int i = 0;
   do
@@ -163,6 +558,75 @@ int main(int argc, char** argv)
       else
         ++i;
     }
+    else if (opt == "-b" || opt == "--backend")
+    {
+      if (i < argc-1)
+      {
+        backend = std::string(argv[i+1]);
+        i += 2;
+      }
+      else
+        ++i;
+    }
+    else if (opt == "--headless")
+    {
+      headless = true;
+      ++i;
+    }
+    else if (opt == "-v" || opt == "--video")
+    {
+      saveVideo = true;
+      if (i < argc-1)
+      {
+        videoTarget = std::string(argv[i+1]);
+        i += 2;
+      }
+      else
+        ++i;
+    }
+    else if (opt == "--variants")
+    {
+      if (i < argc-1)
+      {
+        variants = std::max(std::atoi(argv[i+1]), 0);
+        i += 2;
+      }
+      else
+        ++i;
+    }
+    else if (opt == "--generations")
+    {
+      if (i < argc-1)
+      {
+        // a..b, or a lone generation.
+        std::string range(argv[i+1]);
+        size_t dots = range.find("..");
+        firstGeneration = std::atoi(range.substr(0, dots).c_str());
+        lastGeneration = (dots != std::string::npos) ? std::atoi(range.substr(dots + 2).c_str()) : firstGeneration;
+        i += 2;
+      }
+      else
+        ++i;
+    }
+    else if (opt == "--frames")
+    {
+      if (i < argc-1)
+      {
+        // a..b, or a lone frame.
+        std::string range(argv[i+1]);
+        size_t dots = range.find("..");
+        firstFrame = std::atoi(range.substr(0, dots).c_str());
+        lastFrame = (dots != std::string::npos) ? std::atoi(range.substr(dots + 2).c_str()) : firstFrame;
+        i += 2;
+      }
+      else
+        ++i;
+    }
+    else if (opt == "--atlas")
+    {
+      atlas = true;
+      ++i;
+    }
     else if (opt == "-a" || opt == "--animation")
     {
       saveFinal = true;
@@ -185,23 +649,107 @@ int main(int argc, char** argv)
   ConfigurationType config;
   ConfigParser parser(iniFile, config);
 
-  SDL_Window* window;
-  SDL_GLContext gl;
-  bool success = InitSDL(window, gl, config);
+  if (!backend.empty()) config.Window.Backend = backend;
+  if (headless) config.Window.Headless = true;
 
-  if (!success)
+  bool useGL = (config.Window.Backend == "gl");
+  if (!useGL && config.Window.Backend != "cpu")
   {
+    std::cerr << "Unknown backend \"" << config.Window.Backend << "\". Expected gl or cpu." << std::endl;
     exit(-1);
   }
 
-  glClearColor(config.General.Background.Red, config.General.Background.Green, config.General.Background.Blue, 0.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+  SDL_Window* window = NULL;
+  SDL_GLContext gl = NULL;
+  HeadlessContext headlessGL;
+  if (useGL)
+  {
+    bool success;
+    if (config.Window.Headless)
+      success = InitHeadless(headlessGL, config);
+    else
+      success = InitSDL(window, gl, config);
+
+    if (!success || !InitGLEW())
+    {
+      exit(-1);
+    }
+  }
+  else if (config.Window.Display)
+  {
+    std::cout << "The cpu backend has no window. Rendering without display." << std::endl;
+    config.Window.Display = false;
+  }
 
   LSystem lSystem;
   lSystem.Configure(config.System);
+  lSystem.RetainGenerations(config.Window.Display);
   lSystem.Print();
 
-  std::vector<LConstant> axiom = lSystem.GenerateNthAxiom(config.General.Generation);
+  // With a scene, level of detail or instancing the full axiom is never
+  // expanded here; the loop below prepares the image straight from the rules.
+  bool instancingSupported = useGL && GLRenderer::InstancingSupported();
+  bool scene = UseScene(config);
+  bool levelOfDetail = UseLevelOfDetail(config, lSystem);
+  bool instancing = UseInstancing(config, lSystem, instancingSupported);
+  if (config.Scene.Count > 0 && !scene)
+  {
+    std::cout << "A scene needs a still image drawn at once. Drawing a single copy." << std::endl;
+  }
+  else if ((scene || (variants > 0 && atlas)) && useGL && !instancingSupported)
+  {
+    std::cout << "Scenes and atlases need GL 3.3 to draw with the gl backend. Use the cpu backend instead." << std::endl;
+    exit(-1);
+  }
+  else if (config.General.Lod > 0.0f && !levelOfDetail && !scene)
+  {
+    std::cout << "Level of detail needs a still image of a system without weighted rules. Expanding in full." << std::endl;
+  }
+  else if (config.General.Instancing && config.General.Lod <= 0.0f && !instancing && !scene)
+  {
+    std::cout << "Instancing needs the gl backend with GL 3.3, and a still image drawn at once of a system without weighted rules. Expanding in full." << std::endl;
+  }
+
+  // A sweep draws every frame from one expansion of the configured
+  // generation, with only the turtle settings changing.
+  if (variants > 0 && firstGeneration >= 0)
+  {
+    std::cerr << "--variants and --generations can't be combined. Choose one." << std::endl;
+    exit(-1);
+  }
+
+  bool generations = firstGeneration >= 0;
+  if (generations && lastGeneration < firstGeneration)
+  {
+    std::cerr << "Generation range must run from lowest to highest." << std::endl;
+    exit(-1);
+  }
+
+  bool sweep = variants == 0 && !generations && config.Sweep.Frames > 0;
+  if (sweep && config.Sweep.Parameter != "angle" && config.Sweep.Parameter != "length" && config.Sweep.Parameter != "startingrotation")
+  {
+    std::cerr << "Unknown sweep parameter \"" << config.Sweep.Parameter << "\". Expected angle, length or startingrotation." << std::endl;
+    exit(-1);
+  }
+
+  // A frame range seeks straight to its first frame, so separate runs can
+  // each write their own part of one animation.
+  if (firstFrame > 0 && lastFrame < firstFrame)
+  {
+    std::cerr << "Frame range must run from lowest to highest." << std::endl;
+    exit(-1);
+  }
+  else if (firstFrame > 0 && !config.General.Animate)
+  {
+    std::cout << "A frame range needs an animation. Drawing the whole image." << std::endl;
+    firstFrame = lastFrame = 0;
+  }
+
+  bool fromRules = variants > 0 || generations || (!sweep && (scene || levelOfDetail || instancing));
+
+  ExpansionCache cache(config.Cache);
+  uint64_t axiomKey = 0;
+  std::vector<LConstant> axiom = fromRules ? lSystem.Axiom() : GenerateAxiom(lSystem, cache, config, axiomKey);
   
   int stepsPerFrame = axiom.size();
   if (config.General.AnimateTime > 0.0f)
@@ -211,16 +759,28 @@ int main(int argc, char** argv)
   }
   int endFrames = (int)std::round(config.General.EndFrameTime * config.Window.Framerate);
 
-  std::cout << std::endl << config.General.Generation << " generation axiom. Length=" << axiom.size() << "." << std::endl;
+  if (!fromRules) std::cout << std::endl << config.General.Generation << " generation axiom. Length=" << axiom.size() << "." << std::endl;
   if (config.General.Animate) std::cout << "Rendering " << stepsPerFrame << " steps per frame. Lingering on final frame for " << endFrames << " frames." << std::endl;
 
-  LSystemRenderer LS_Renderer(window, axiom, config);
+  std::unique_ptr<LSystemRenderer> LS_Renderer;
+  if (useGL)
+    LS_Renderer = std::make_unique<GLRenderer>(window, axiom, config);
+  else
+    LS_Renderer = std::make_unique<CpuRenderer>(axiom, config);
 
-  if (config.General.Center) LS_Renderer.Center();
+  LS_Renderer->SetCache(&cache, axiomKey);
 
-  LS_Renderer.SetupGL(config.Window.Display);
+  if (config.General.Center && !sweep && !generations) LS_Renderer->Center();
+
+  LS_Renderer->Setup(config.Window.Display);
+
+  if (saveVideo && !LS_Renderer->OpenVideo(videoTarget.empty() ? "lsystem.y4m" : videoTarget))
+  {
+    exit(-1);
+  }
   
   std::filesystem::path animationPath(animationFolder);
+  std::string frameExtension = ImageWriter::Extension(ImageWriter::FromPath("frame." + config.Output.FrameFormat));
 
   if (allFrames)
   {
@@ -230,46 +790,249 @@ int main(int argc, char** argv)
   if (saveFinal)
   {
     std::filesystem::path outputPath(outputFile);
-    std::filesystem::create_directories(outputPath.parent_path());
+    if (outputPath.has_parent_path()) std::filesystem::create_directories(outputPath.parent_path());
+  }
+
+  // Only an interactive window reloads the ini when it is saved.
+  std::unique_ptr<ConfigWatcher> watcher;
+  if (window && config.Window.Display)
+  {
+    watcher = std::make_unique<ConfigWatcher>(iniFile);
   }
 
+  bool background = (window && config.Window.Display);
+
+  BackgroundTask task;
+  bool preparing = false;
+  bool preparingExpand = false;
+
+  struct Prepared
+  {
+    std::vector<LConstant> Axiom;
+    uint64_t Key;
+    Geometry Layout;
+    InstancedGeometry Instances;
+    float X;
+    float Y;
+  };
+
+  Prepared pending;
+
+  // Coarser generations handed over while the full one is still expanding.
+  Prepared preview;
+  int previewGeneration = -1;
+  std::mutex previewMutex;
+
   int frame          = 0;
   int captureCount   = 0;
   bool saved         = false;
   bool doneRendering = false;
-  bool recalc        = false;
+  bool recalc        = fromRules;
+  bool reinterpret   = false;
+  bool redraw        = false;
   bool closeWindow   = false;
   bool capture       = false;
   bool done          = false;
+  int generationStep = 0;
+  int scrub          = 0;
+
+  // Where the window looks at the image, and where it looked when the
+  // current geometry was walked. Only level of detail walks for a view;
+  // otherwise the whole difference is made up on the GPU.
+  View view;
+  View drawnView;
+  bool preparingDetail = false;
+  Navigation navigation;
+
+  if (variants > 0)
+  {
+    RenderVariants(*LS_Renderer, lSystem, config, variants, atlas, outputFile);
+    done = true;
+  }
+  else if (generations)
+  {
+    RenderGenerations(*LS_Renderer, lSystem, axiom, config, firstGeneration, lastGeneration, outputFile);
+    done = true;
+  }
+  else if (sweep)
+  {
+    RenderSweep(*LS_Renderer, axiom, config, saveVideo, animationPath, frameExtension);
+    done = true;
+  }
 
   while(!done)
   {
-    if (recalc)
+    // Expansion and interpretation run in the background while a window is
+    // open, which keeps showing the previous result until the new one is
+    // ready. Otherwise they are waited for straight away.
+    if (recalc || reinterpret)
+    {
+      bool expand = recalc;
+      preparing = true;
+      preparingExpand = expand;
+      preparingDetail = UseLevelOfDetail(config, lSystem);
+      pending.Key = axiomKey;
+
+      task.Start([&, expand](Progress& progress)
+      {
+        if (UseLevelOfDetail(config, lSystem))
+        {
+          if (expand)
+          {
+            pending.Axiom = lSystem.Axiom();
+            pending.Key = 0;
+          }
+
+          if (LS_Renderer->PrepareLevelOfDetail(lSystem, config.General.Generation, view, pending.Layout, pending.X, pending.Y, &progress))
+          {
+            std::cout << "Drew generation " << config.General.Generation << " with level of detail as " << pending.Layout.Segments.size() << " segments." << std::endl;
+          }
+          return;
+        }
+
+        if (UseScene(config))
+        {
+          if (expand)
+          {
+            pending.Axiom = lSystem.Axiom();
+            pending.Key = 0;
+          }
+
+          if (LS_Renderer->PrepareScene(lSystem, config.General.Generation, pending.Layout, pending.Instances, pending.X, pending.Y, &progress))
+          {
+            size_t segments = 0;
+            for (const Geometry& mesh : pending.Instances.Meshes)
+            {
+              segments += mesh.Segments.size();
+            }
+
+            std::cout << "Placed " << pending.Instances.Instances.size() << " copies of " << pending.Instances.Meshes.size() << " variants of generation " << config.General.Generation
+              << ", " << segments << " segments in all." << std::endl;
+          }
+          return;
+        }
+
+        if (UseInstancing(config, lSystem, instancingSupported))
+        {
+          if (expand)
+          {
+            pending.Axiom = lSystem.Axiom();
+            pending.Key = 0;
+          }
+
+          if (LS_Renderer->PrepareInstanced(lSystem, config.General.Generation, pending.Layout, pending.Instances, pending.X, pending.Y, &progress))
+          {
+            size_t segments = pending.Layout.Segments.size();
+            for (const Geometry& mesh : pending.Instances.Meshes)
+            {
+              segments += mesh.Segments.size();
+            }
+
+            std::cout << "Drew generation " << config.General.Generation << " as " << pending.Instances.Instances.size() << " instances of " << pending.Instances.Meshes.size()
+              << " meshes, " << segments << " segments in all." << std::endl;
+          }
+          return;
+        }
+
+        if (expand && background && config.General.Preview > 0 && config.General.Generation > 1)
+        {
+          // Show a few coarser generations first, drawn with longer segments
+          // so they cover about the same area. The extent is assumed to keep
+          // growing at the rate measured between the last two generations.
+          int target = config.General.Generation;
+          int first = std::max(target - config.General.Preview, 1);
+
+          float previous = Extent(config.General, lSystem.GenerateNthAxiom(first - 1, &progress));
+
+          for (int generation = first; generation < target && !progress.Cancelled(); ++generation)
+          {
+            Prepared coarse;
+            coarse.Axiom = lSystem.GenerateNthAxiom(generation, &progress);
+            coarse.Key = 0;
+            if (progress.Cancelled()) return;
+
+            float extent = Extent(config.General, coarse.Axiom);
+            float growth = (previous > 0.0f && extent > previous) ? extent / previous : 1.0f;
+            previous = extent;
+
+            float scale = std::pow(growth, (float)(target - generation));
+            if (!LS_Renderer->Prepare(coarse.Axiom, 0, coarse.Layout, coarse.X, coarse.Y, &progress, scale)) return;
+
+            std::lock_guard<std::mutex> lock(previewMutex);
+            preview = std::move(coarse);
+            previewGeneration = generation;
+          }
+        }
+
+        if (expand)
+        {
+          pending.Axiom = GenerateAxiom(lSystem, cache, config, pending.Key, &progress);
+          if (progress.Cancelled()) return;
+        }
+
+        LS_Renderer->Prepare(expand ? pending.Axiom : axiom, pending.Key, pending.Layout, pending.X, pending.Y, &progress);
+      });
+
+      if (!background) task.Wait();
+
+      recalc = false;
+      reinterpret = false;
+    }
+
+    if (preparing)
+    {
+      std::lock_guard<std::mutex> lock(previewMutex);
+      if (previewGeneration >= 0)
+      {
+        std::cout << "Previewing generation " << previewGeneration << "." << std::endl;
+
+        axiom.swap(preview.Axiom);
+        axiomKey = 0;
+        LS_Renderer->Adopt(preview.Layout, preview.X, preview.Y, axiomKey);
+        drawnView = View();
+        LS_Renderer->SetView(Relative(view, drawnView));
+        previewGeneration = -1;
+        redraw = true;
+      }
+    }
+
+    if (preparing && task.Finished())
     {
-      glClear(GL_COLOR_BUFFER_BIT);
-      SDL_GL_SwapWindow(window);
-      glClear(GL_COLOR_BUFFER_BIT);
-      
-      std::vector<LConstant> axiom = lSystem.GenerateNthAxiom(config.General.Generation);
-      
-      int stepsPerFrame = axiom.size();
+      preparing = false;
+
+      if (preparingExpand)
+      {
+        axiom.swap(pending.Axiom);
+        pending.Axiom.clear();
+        if (!UseScene(config) && !UseLevelOfDetail(config, lSystem) && !UseInstancing(config, lSystem, instancingSupported)) std::cout << std::endl << config.General.Generation << " generation axiom. Length=" << axiom.size() << "." << std::endl;
+      }
+
+      axiomKey = pending.Key;
+      LS_Renderer->Adopt(pending.Layout, pending.X, pending.Y, axiomKey);
+      LS_Renderer->AdoptInstances(pending.Instances);
+      drawnView = preparingDetail ? view : View();
+      LS_Renderer->SetView(Relative(view, drawnView));
+      redraw = true;
+    }
+
+    ShowProgress(window, task);
+
+    if (redraw)
+    {
+      stepsPerFrame = axiom.size();
       if (config.General.AnimateTime > 0.0f)
       {
         stepsPerFrame = (int)std::round(axiom.size() / (config.General.AnimateTime * config.Window.Framerate));
         stepsPerFrame = std::max(stepsPerFrame, 1);
       }
-      int endFrames = (int)std::round(config.General.EndFrameTime * config.Window.Framerate);
+      endFrames = (int)std::round(config.General.EndFrameTime * config.Window.Framerate);
 
-      std::cout << std::endl << config.General.Generation << " generation axiom. Length=" << axiom.size() << "." << std::endl;
       if (config.General.Animate) std::cout << "Rendering " << stepsPerFrame << " steps per frame. Lingering on final frame for " << endFrames << " frames." << std::endl;
 
-      LS_Renderer.SetAxiom(axiom);
+      LS_Renderer->Restyle();
+      LS_Renderer->Setup(config.Window.Display);
 
-      if (config.General.Center) LS_Renderer.Center();
-
-      LS_Renderer.SetupGL(config.Window.Display);
-
-      recalc = false;
+      redraw = false;
       doneRendering = false;
       frame = 0;
     }
@@ -279,66 +1042,250 @@ int main(int argc, char** argv)
 
     if (!doneRendering)
     {
-      glDrawBuffer(GL_BACK);
-      glClear(GL_COLOR_BUFFER_BIT);
+      // Progressive drawing keeps adding to the same image over several
+      // frames, so the window stays responsive while a large system fills in.
+      bool progressive = config.Window.Display && !config.General.Animate && config.General.FrameBudget > 0.0f;
+
+      if (!progressive) LS_Renderer->Clear();
   
-      LS_Renderer.SetupRender();
+      LS_Renderer->SetupRender();
 
       if (config.General.Animate)
       {
-        doneRendering = finishedRenderingThisFrame = LS_Renderer.RenderNextSteps(stepsPerFrame);
+        if (frame == 0 && firstFrame > 1)
+        {
+          // Frames past the last one drawing anything linger on the final image.
+          int drawingFrames = ((int)axiom.size() + stepsPerFrame - 1) / stepsPerFrame;
+          endFrames -= std::max(firstFrame - drawingFrames, 0);
+
+          LS_Renderer->SeekSteps((firstFrame - 1) * stepsPerFrame);
+          frame = firstFrame - 1;
+        }
+
+        doneRendering = finishedRenderingThisFrame = LS_Renderer->RenderNextSteps(stepsPerFrame);
         ++frame;
 
         if (allFrames)
         {
-          std::filesystem::path filename(std::to_string(frame) + ".png");
+          std::filesystem::path filename(std::to_string(frame) + frameExtension);
           std::filesystem::path filepath = animationPath / filename;
-          SDL_GL_SwapWindow(window);
-          LS_Renderer.SaveScreenshot(filepath.string(), config.General.Padding);
-          SDL_GL_SwapWindow(window);
+          LS_Renderer->QueueScreenshot(filepath.string(), config.General.Padding);
+        }
+
+        if (saveVideo)
+        {
+          LS_Renderer->QueueVideoFrame(config.General.Padding);
+        }
+
+        if (lastFrame > 0 && frame >= lastFrame)
+        {
+          doneRendering = true;
+          saved = true;
+          LS_Renderer->FlushScreenshots();
+          if (allFrames || saveVideo) std::cout << "Finished writing frames " << firstFrame << " to " << lastFrame << "." << std::endl;
         }
       }
+      else if (progressive)
+      {
+        doneRendering = finishedRenderingThisFrame = LS_Renderer->RenderProgressive(config.General.FrameBudget);
+      }
       else
       {
-        doneRendering = finishedRenderingThisFrame = LS_Renderer.Render();
+        doneRendering = finishedRenderingThisFrame = LS_Renderer->Render();
       }
 
-      glFlush();
-      glFinish();
-      SDL_GL_SwapWindow(window);
+      LS_Renderer->Present();
     }
     
-    if (doneRendering && !finishedRenderingThisFrame && !saved && (saveFinal || allFrames))
+    if (doneRendering && !finishedRenderingThisFrame && !saved && (saveFinal || saveVideo))
     {
-      std::string filepath = outputFile;
-      if (allFrames)
+      // Image sequences and videos linger on the final frame; a single
+      // image is written once.
+      saved = true;
+      if (allFrames || saveVideo)
       {
         ++frame;
         --endFrames;
-        std::filesystem::path filename(std::to_string(frame) + ".png");
+        saved = (endFrames <= 0) || (lastFrame > 0 && frame >= lastFrame);
+      }
+
+      if (allFrames)
+      {
+        std::filesystem::path filename(std::to_string(frame) + frameExtension);
         std::filesystem::path p = animationPath / filename;
-        filepath = p.string();
-        if (endFrames == 0)
-        {
-          saved = true;
-        }
+        LS_Renderer->QueueScreenshot(p.string(), config.General.Padding);
       }
-      else
+      else if (saveFinal && saved)
       {
-        saved = true;
+        LS_Renderer->QueueScreenshot(outputFile, config.General.Padding);
       }
 
-      SDL_GL_SwapWindow(window);
-      LS_Renderer.SaveScreenshot(filepath, config.General.Padding);
-      SDL_GL_SwapWindow(window);
+      if (saveVideo)
+      {
+        LS_Renderer->QueueVideoFrame(config.General.Padding);
+      }
 
       if (saved)
       {
-        std::cout << "Saved resultant curve to PNG." << std::endl;
+        LS_Renderer->FlushScreenshots();
+        if (saveFinal) std::cout << "Saved resultant curve to PNG." << std::endl;
+        if (saveVideo) std::cout << "Finished writing animation." << std::endl;
       }
     }
 
-    done = HandleEvents(recalc, capture);
+    if (window) done = HandleEvents(recalc, capture, generationStep, scrub, navigation);
+
+    // The arrow keys jump a second of the animation back or forward, which
+    // is drawn straight from the geometry already walked.
+    if (scrub != 0 && config.General.Animate && !allFrames && !saveVideo)
+    {
+      LS_Renderer->SeekSteps(scrub * config.Window.Framerate * stepsPerFrame - stepsPerFrame);
+      doneRendering = false;
+    }
+    scrub = 0;
+
+    // Navigating moves what is already drawn straight away where the
+    // backend can. A level of detail image is also walked afresh for the
+    // new view, which replaces it once ready.
+    bool navigate = navigation.Moved();
+    bool rewalk = navigate && UseLevelOfDetail(config, lSystem);
+
+    // F5 redraws the same generation, which for unseeded stochastic rules
+    // means choosing again; stepping reuses the generations already derived.
+    bool reroll = recalc && !lSystem.Reproducible();
+    bool reload = watcher && watcher->Changed();
+
+    // Work in the background reads the configuration and the LSystem, so it
+    // is stopped before either changes, and restarted afterwards.
+    if (preparing && (recalc || reroll || generationStep != 0 || reload || rewalk))
+    {
+      task.Cancel();
+      preparing = false;
+      previewGeneration = -1;
+      if (preparingExpand)
+        recalc = true;
+      else
+        reinterpret = true;
+    }
+
+    if (reroll)
+    {
+      lSystem.ClearGenerations();
+    }
+
+    if (navigate)
+    {
+      View next = navigation.Reset ? View() : view;
+
+      float middleX = config.Window.Width / 2.0f;
+      float middleY = config.Window.Height / 2.0f;
+
+      if (navigation.Fit)
+      {
+        // Scale the current geometry to fill the window, centred.
+        float minX, minY, maxX, maxY;
+        LS_Renderer->Bounds(minX, minY, maxX, maxY);
+
+        float scale = FIT_FILL * std::min(config.Window.Width / std::max(maxX - minX, 1.0f), config.Window.Height / std::max(maxY - minY, 1.0f));
+        next.Zoom = drawnView.Zoom * scale;
+        next.X = drawnView.X * scale - ((minX + maxX) / 2.0f - middleX) * scale;
+        next.Y = drawnView.Y * scale - ((minY + maxY) / 2.0f - middleY) * scale;
+      }
+
+      // The window's y runs down, the image's up. Zooming keeps the point
+      // under the mouse where it is.
+      float atX = navigation.AtX - middleX;
+      float atY = (config.Window.Height - navigation.AtY) - middleY;
+      next.X = atX + (next.X - atX) * navigation.Zoom + navigation.PanX;
+      next.Y = atY + (next.Y - atY) * navigation.Zoom - navigation.PanY;
+      next.Zoom *= navigation.Zoom;
+
+      if (LS_Renderer->SetView(Relative(next, drawnView)))
+      {
+        view = next;
+        doneRendering = false;
+      }
+      else if (rewalk)
+      {
+        view = next;
+      }
+
+      if (rewalk) reinterpret = true;
+    }
+
+    navigation = Navigation();
+
+    if (generationStep != 0)
+    {
+      int generation = std::max(config.General.Generation + generationStep, 0);
+      recalc = recalc || (generation != config.General.Generation);
+      config.General.Generation = generation;
+      generationStep = 0;
+    }
+
+    if (reload)
+    {
+      // A value caught half typed, such as a weight that doesn't read as a
+      // number yet, fails the parse like any other error.
+      ConfigurationType reloaded;
+      bool valid = false;
+      try
+      {
+        ConfigParser reparser(iniFile, reloaded);
+        valid = reparser.Valid();
+      }
+      catch (const std::exception&)
+      {
+        valid = false;
+      }
+
+      if (!backend.empty()) reloaded.Window.Backend = backend;
+      if (headless) reloaded.Window.Headless = true;
+
+      if (!valid)
+      {
+        std::cerr << "Failed to parse " << iniFile << ". Keeping the current settings." << std::endl;
+      }
+      else
+      {
+        bool restart = false;
+        ConfigChange change = ConfigParser::Compare(config, reloaded, restart);
+        if (restart)
+        {
+          std::cout << "Changes to [window], [output], [cache] and antialias take effect on restart." << std::endl;
+        }
+
+        reloaded.Window = config.Window;
+        reloaded.Output = config.Output;
+        reloaded.Cache = config.Cache;
+        reloaded.General.Antialias = config.General.Antialias;
+        config = reloaded;
+
+        switch (change)
+        {
+          case ConfigChange::System:
+            std::cout << "Reloaded " << iniFile << ". Expanding the new system." << std::endl;
+            lSystem = LSystem();
+            lSystem.Configure(config.System);
+            recalc = true;
+            break;
+          case ConfigChange::Generation:
+            std::cout << "Reloaded " << iniFile << ". Changing generation." << std::endl;
+            recalc = true;
+            break;
+          case ConfigChange::Reinterpret:
+            std::cout << "Reloaded " << iniFile << ". Reinterpreting the axiom." << std::endl;
+            reinterpret = true;
+            break;
+          case ConfigChange::Redraw:
+            std::cout << "Reloaded " << iniFile << ". Redrawing." << std::endl;
+            redraw = true;
+            break;
+          default:
+            break;
+        }
+      }
+    }
 
     if (capture)
     {
@@ -350,28 +1297,32 @@ int main(int argc, char** argv)
       std::filesystem::path newName(name.string() + "_" + std::to_string(++captureCount) + extension.string());
       std::filesystem::path resultant = folder / newName;
 
-      SDL_GL_SwapWindow(window);
-      LS_Renderer.SaveScreenshot(resultant.string(), config.General.Padding);
-      SDL_GL_SwapWindow(window);
+      LS_Renderer->SaveScreenshot(resultant.string(), config.General.Padding);
 
       capture = false;
     }
 
     if (!config.Window.Display)
     {
-      if (saveFinal && saved && doneRendering)
+      if ((saveFinal || saveVideo) && saved && doneRendering)
         done = true;
 
-      if(!saveFinal && doneRendering)
+      if(!saveFinal && !saveVideo && doneRendering)
         done = true;
     }
 
     Uint64 end = SDL_GetPerformanceCounter();
     float elapsedMS = (end - start) / (float)SDL_GetPerformanceFrequency() * 1000.0f;
     float delay = std::max(std::floor((1000.0f / config.Window.Framerate) - elapsedMS), 0.0f);
-    SDL_Delay(delay);
+    if (config.Window.Display) SDL_Delay(delay);
   }
 
+  task.Cancel();
+  LS_Renderer->FlushScreenshots();
+  LS_Renderer->CloseVideo();
+  LS_Renderer.reset();
+  headlessGL.Destroy();
+
   if (gl) SDL_GL_DeleteContext(gl);
   if (window) SDL_DestroyWindow(window);
 
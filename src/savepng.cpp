@@ -6,6 +6,12 @@
  */
 #include <SDL.h>
 #include <png.h>
+#include <zlib.h>
+#include "savepng.h"
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
 
 #define SUCCESS 0
 #define ERROR -1
@@ -56,16 +62,505 @@ SDL_Surface *SDL_PNGFormatAlpha(SDL_Surface *src)
 	return surf;
 }
 
+static const Uint8 *png_source_row(SDL_Surface *surface, int flip, int y)
+{
+	int row = flip ? surface->h - 1 - y : y;
+	return (const Uint8*)surface->pixels + row * surface->pitch;
+}
+
+/* Colour reduction
+ *
+ * Flat-colour renders hold a background, a line colour and the antialiasing
+ * ramp between them, so a palette almost always fits. Distinct colours are
+ * counted with a small open-addressed hash; runs of one colour, which make
+ * up most of a render, skip the lookup entirely.
+ */
+#define PALETTE_SLOTS 1024
+#define MAX_QUANTIZE_SHIFT 4
+
+typedef struct
+{
+	Uint32 keys[PALETTE_SLOTS];
+	Sint16 slots[PALETTE_SLOTS];
+	Uint32 colors[256];
+	int ncolors;
+} png_palette;
+
+typedef struct
+{
+	int shift;
+	int opaque;
+	int depth;
+	int ntrans;
+	Uint8 remap[256];
+	png_palette palette;
+} png_reduction;
+
+static int png_is_rgba32(SDL_Surface *surface)
+{
+	return surface->format->BytesPerPixel == 4 && !surface->format->palette
+		&& surface->format->Rmask == rmask && surface->format->Gmask == gmask && surface->format->Bmask == bmask;
+}
+
+/* Rounds every channel to a multiple of 1 << shift, keeping 255 reachable */
+static Uint32 png_quantize(Uint32 p, int shift)
+{
+	Uint8 *c = (Uint8*)&p;
+	int i, v, half = 1 << (shift - 1);
+	for (i = 0; i < 4; i++) {
+		v = ((c[i] + half) >> shift) << shift;
+		c[i] = (Uint8)(v > 255 ? 255 : v);
+	}
+	return p;
+}
+
+static Uint32 png_reduced_pixel(SDL_Surface *surface, const png_reduction *r, Uint32 p)
+{
+	if (!surface->format->Amask) p |= amask;
+	return r->shift ? png_quantize(p, r->shift) : p;
+}
+
+/* Returns the palette index of key, adding it if there is room, or -1 */
+static int png_palette_find(png_palette *pal, Uint32 key)
+{
+	Uint32 slot = (key * 2654435761u) >> 22;
+	while (pal->slots[slot] >= 0) {
+		if (pal->keys[slot] == key)
+			return pal->slots[slot];
+		slot = (slot + 1) & (PALETTE_SLOTS - 1);
+	}
+	if (pal->ncolors == 256)
+		return -1;
+	pal->keys[slot] = key;
+	pal->slots[slot] = (Sint16)pal->ncolors;
+	pal->colors[pal->ncolors] = key;
+	return pal->ncolors++;
+}
+
+/* Collects the palette at r->shift. Returns 0 once it overflows, though the
+ * scan carries on while the image still looks opaque. */
+static int png_collect_palette(SDL_Surface *surface, png_reduction *r)
+{
+	int x, y, fits = 1;
+	Uint32 p, last = 0;
+	int have_last = 0;
+
+	memset(r->palette.slots, 0xFF, sizeof(r->palette.slots));
+	r->palette.ncolors = 0;
+	r->opaque = 1;
+
+	for (y = 0; y < surface->h && (fits || r->opaque); y++) {
+		const Uint32 *row = (const Uint32*)((const Uint8*)surface->pixels + y * surface->pitch);
+		for (x = 0; x < surface->w; x++) {
+			if (have_last && row[x] == last)
+				continue;
+			last = row[x];
+			have_last = 1;
+
+			p = png_reduced_pixel(surface, r, last);
+			if ((p & amask) != amask)
+				r->opaque = 0;
+			if (fits && png_palette_find(&r->palette, p) < 0)
+				fits = 0;
+			if (!fits && !r->opaque)
+				break;
+		}
+	}
+	return fits;
+}
+
+/* Decides how to store an RGBA surface. Returns 1 if it should be written
+ * indexed, 0 otherwise; r->opaque then says whether alpha can be dropped. */
+static int png_reduce(SDL_Surface *surface, const SDL_SavePNGOptions *options, png_reduction *r)
+{
+	int i, n, fits;
+
+	r->shift = 0;
+	fits = png_collect_palette(surface, r);
+	while (!fits && options->reduce == SDL_SAVEPNG_REDUCE_QUANTIZE && r->shift < MAX_QUANTIZE_SHIFT) {
+		r->shift++;
+		fits = png_collect_palette(surface, r);
+	}
+	if (!fits) {
+		/* Quantizing didn't help; whether alpha is needed is decided losslessly */
+		if (r->shift) {
+			r->shift = 0;
+			png_collect_palette(surface, r);
+		}
+		return 0;
+	}
+
+	/* tRNS only covers a prefix of the palette, so translucent entries go first */
+	n = 0;
+	for (i = 0; i < r->palette.ncolors; i++)
+		if ((r->palette.colors[i] & amask) != amask)
+			r->remap[i] = (Uint8)n++;
+	r->ntrans = n;
+	for (i = 0; i < r->palette.ncolors; i++)
+		if ((r->palette.colors[i] & amask) == amask)
+			r->remap[i] = (Uint8)n++;
+
+	n = r->palette.ncolors;
+	r->depth = n <= 2 ? 1 : n <= 4 ? 2 : n <= 16 ? 4 : 8;
+	return 1;
+}
+
+/* Packs the surface into palette indices at r->depth bits, rows in output order */
+static void png_pack_indexed(SDL_Surface *surface, const SDL_SavePNGOptions *options, png_reduction *r, Uint8 *out, size_t rowbytes)
+{
+	int x, y, index = 0, bit;
+	Uint32 last = 0;
+	int have_last = 0;
+
+	memset(out, 0, rowbytes * surface->h);
+	for (y = 0; y < surface->h; y++, out += rowbytes) {
+		const Uint32 *row = (const Uint32*)png_source_row(surface, options->flip, y);
+		for (x = 0; x < surface->w; x++) {
+			if (!have_last || row[x] != last) {
+				last = row[x];
+				have_last = 1;
+				index = r->remap[png_palette_find(&r->palette, png_reduced_pixel(surface, r, last))];
+			}
+			bit = x * r->depth;
+			out[bit >> 3] |= (Uint8)(index << (8 - r->depth - (bit & 7)));
+		}
+	}
+}
+
+/* Parallel encoder
+ *
+ * The filtered image is split into row bands. Each band is deflated on its
+ * own thread as a raw deflate stream, primed with the tail of the previous
+ * band as a dictionary and ended with a sync flush (the last band with
+ * Z_FINISH), so the byte-aligned pieces concatenate into one valid deflate
+ * stream. A zlib header and the combined Adler-32 turn that into the IDAT
+ * payload, which is written with hand-built chunks.
+ */
+#define BAND_MIN_BYTES (256 * 1024)
+#define DICT_BYTES 32768
+
+typedef struct
+{
+	int first;
+	int last;
+	Uint8 *filtered;
+	size_t filtered_len;
+	Uint8 *out;
+	size_t out_len;
+	uLong adler;
+	int ok;
+} png_band;
+
+static int png_paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return a;
+	if (pb <= pc) return b;
+	return c;
+}
+
+/* Writes the filter type byte followed by the filtered row into out. */
+static void png_filter_row(int type, const Uint8 *row, const Uint8 *prev, size_t rowbytes, int bpp, Uint8 *out)
+{
+	size_t i, lead = (size_t)bpp < rowbytes ? (size_t)bpp : rowbytes;
+	out[0] = (Uint8)type;
+	out++;
+
+	/* The first row of the image has an all-zero row above it */
+	if (!prev) {
+		if (type == PNG_FILTER_VALUE_UP) type = PNG_FILTER_VALUE_NONE;
+		else if (type == PNG_FILTER_VALUE_PAETH) type = PNG_FILTER_VALUE_SUB;
+		else if (type == PNG_FILTER_VALUE_AVG) {
+			for (i = 0; i < lead; i++) out[i] = row[i];
+			for (; i < rowbytes; i++) out[i] = (Uint8)(row[i] - (row[i - bpp] >> 1));
+			return;
+		}
+	}
+
+	switch (type) {
+		case PNG_FILTER_VALUE_SUB:
+			for (i = 0; i < lead; i++) out[i] = row[i];
+			for (; i < rowbytes; i++) out[i] = (Uint8)(row[i] - row[i - bpp]);
+			break;
+		case PNG_FILTER_VALUE_UP:
+			for (i = 0; i < rowbytes; i++) out[i] = (Uint8)(row[i] - prev[i]);
+			break;
+		case PNG_FILTER_VALUE_AVG:
+			for (i = 0; i < lead; i++) out[i] = (Uint8)(row[i] - (prev[i] >> 1));
+			for (; i < rowbytes; i++) out[i] = (Uint8)(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+			break;
+		case PNG_FILTER_VALUE_PAETH:
+			for (i = 0; i < lead; i++) out[i] = (Uint8)(row[i] - prev[i]);
+			for (; i < rowbytes; i++) out[i] = (Uint8)(row[i] - png_paeth(row[i - bpp], prev[i], prev[i - bpp]));
+			break;
+		default:
+			memcpy(out, row, rowbytes);
+			break;
+	}
+}
+
+static size_t png_filter_cost(const Uint8 *filtered, size_t rowbytes)
+{
+	size_t i, cost = 0;
+	for (i = 1; i <= rowbytes; i++)
+		cost += abs((signed char)filtered[i]);
+	return cost;
+}
+
+/* Returns row y in output order, copied into buf without its alpha bytes
+ * when stripping. */
+static const Uint8 *png_band_row(SDL_Surface *surface, int flip, int y, int strip, Uint8 *buf)
+{
+	const Uint8 *src = png_source_row(surface, flip, y);
+	int x;
+	if (!strip)
+		return src;
+	for (x = 0; x < surface->w; x++) {
+		buf[3 * x]     = src[4 * x];
+		buf[3 * x + 1] = src[4 * x + 1];
+		buf[3 * x + 2] = src[4 * x + 2];
+	}
+	return buf;
+}
+
+/* scratch holds a filtered row plus, when stripping, two converted rows */
+static void png_filter_band(SDL_Surface *surface, const SDL_SavePNGOptions *options, int strip, png_band *band, Uint8 *scratch)
+{
+	int y, type, best_type;
+	size_t cost, best_cost;
+	int bpp = strip ? 3 : surface->format->BytesPerPixel;
+	size_t rowbytes = (size_t)surface->w * bpp;
+	Uint8 *out = band->filtered;
+	Uint8 *rowbuf = scratch + rowbytes + 1, *prevbuf = rowbuf + rowbytes, *swap;
+	const Uint8 *prev = (band->first > 0) ? png_band_row(surface, options->flip, band->first - 1, strip, prevbuf) : NULL;
+
+	for (y = band->first; y < band->last; y++, out += rowbytes + 1) {
+		const Uint8 *row = png_band_row(surface, options->flip, y, strip, rowbuf);
+
+		switch (options->filter) {
+			case SDL_SAVEPNG_FILTER_NONE:    png_filter_row(PNG_FILTER_VALUE_NONE, row, prev, rowbytes, bpp, out); break;
+			case SDL_SAVEPNG_FILTER_SUB:     png_filter_row(PNG_FILTER_VALUE_SUB, row, prev, rowbytes, bpp, out); break;
+			case SDL_SAVEPNG_FILTER_UP:      png_filter_row(PNG_FILTER_VALUE_UP, row, prev, rowbytes, bpp, out); break;
+			case SDL_SAVEPNG_FILTER_AVERAGE: png_filter_row(PNG_FILTER_VALUE_AVG, row, prev, rowbytes, bpp, out); break;
+			case SDL_SAVEPNG_FILTER_PAETH:   png_filter_row(PNG_FILTER_VALUE_PAETH, row, prev, rowbytes, bpp, out); break;
+			default:
+				/* Adaptive, which is also what libpng does by default for truecolor */
+				best_type = PNG_FILTER_VALUE_NONE;
+				best_cost = (size_t)-1;
+				for (type = PNG_FILTER_VALUE_NONE; type < PNG_FILTER_VALUE_LAST; type++) {
+					png_filter_row(type, row, prev, rowbytes, bpp, scratch);
+					cost = png_filter_cost(scratch, rowbytes);
+					if (cost < best_cost) {
+						best_cost = cost;
+						best_type = type;
+					}
+				}
+				png_filter_row(best_type, row, prev, rowbytes, bpp, out);
+				break;
+		}
+
+		prev = row;
+		if (strip) {
+			swap = rowbuf;
+			rowbuf = prevbuf;
+			prevbuf = swap;
+		}
+	}
+}
+
+static void png_deflate_band(png_band *band, const png_band *previous, int level, int final)
+{
+	z_stream strm;
+	size_t dict_len;
+
+	memset(&strm, 0, sizeof(strm));
+	band->ok = 0;
+	band->adler = adler32(1L, band->filtered, (uInt)band->filtered_len);
+
+	if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return;
+
+	if (previous) {
+		dict_len = previous->filtered_len < DICT_BYTES ? previous->filtered_len : DICT_BYTES;
+		deflateSetDictionary(&strm, previous->filtered + previous->filtered_len - dict_len, (uInt)dict_len);
+	}
+
+	/* Room for the worst case plus the empty stored block of a sync flush */
+	band->out_len = deflateBound(&strm, (uLong)band->filtered_len) + 16;
+	band->out = (Uint8*)malloc(band->out_len);
+	if (!band->out) {
+		deflateEnd(&strm);
+		return;
+	}
+
+	strm.next_in = band->filtered;
+	strm.avail_in = (uInt)band->filtered_len;
+	strm.next_out = band->out;
+	strm.avail_out = (uInt)band->out_len;
+
+	if (deflate(&strm, final ? Z_FINISH : Z_SYNC_FLUSH) == (final ? Z_STREAM_END : Z_OK)
+	&& strm.avail_in == 0 && strm.avail_out > 0) {
+		band->out_len = band->out_len - strm.avail_out;
+		band->ok = 1;
+	}
+	deflateEnd(&strm);
+}
+
+static void png_put_be32(Uint8 *p, Uint32 v)
+{
+	p[0] = (Uint8)(v >> 24);
+	p[1] = (Uint8)(v >> 16);
+	p[2] = (Uint8)(v >> 8);
+	p[3] = (Uint8)v;
+}
+
+static int png_write_chunk_SDL(SDL_RWops *dst, const char *type, const Uint8 *data, size_t len)
+{
+	Uint8 header[8], footer[4];
+	uLong crc;
+
+	png_put_be32(header, (Uint32)len);
+	memcpy(header + 4, type, 4);
+	crc = crc32(0L, header + 4, 4);
+	if (len) crc = crc32(crc, data, (uInt)len);
+	png_put_be32(footer, (Uint32)crc);
+
+	return SDL_RWwrite(dst, header, 1, 8) == 8
+		&& (len == 0 || SDL_RWwrite(dst, data, 1, len) == len)
+		&& SDL_RWwrite(dst, footer, 1, 4) == 4;
+}
+
+/* Returns 1 if written, 0 if the image doesn't suit the parallel path, or
+ * ERROR with SDL_SetError called. */
+static int png_write_parallel(SDL_Surface *surface, SDL_RWops *dst, const SDL_SavePNGOptions *options, int strip)
+{
+	static const Uint8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	Uint8 ihdr[13], zheader[2] = { 0x78, 0x9C }, ztrailer[4];
+	int bpp = strip ? 3 : surface->format->BytesPerPixel;
+	size_t rowbytes = (size_t)surface->w * bpp;
+	size_t raw = (rowbytes + 1) * surface->h;
+	int i, nbands, rows_per_band, level, result = 1;
+	png_band *bands;
+	Uint8 *filtered;
+	uLong adler;
+
+	if (surface->format->palette || (surface->format->BytesPerPixel != 3 && surface->format->BytesPerPixel != 4)
+	|| surface->format->Rmask != rmask || surface->format->Gmask != gmask || surface->format->Bmask != bmask)
+		return 0;
+
+	nbands = (int)(raw / BAND_MIN_BYTES);
+	if (nbands > options->threads) nbands = options->threads;
+	if (nbands > surface->h) nbands = surface->h;
+	if (nbands < 2)
+		return 0;
+
+	level = options->compression > 0 ? options->compression : Z_DEFAULT_COMPRESSION;
+
+	bands = (png_band*)calloc(nbands, sizeof(png_band));
+	filtered = (Uint8*)malloc(raw);
+	if (!bands || !filtered) {
+		free(bands);
+		free(filtered);
+		SDL_SetError("Out of memory for parallel PNG encoding\n");
+		return (ERROR);
+	}
+
+	rows_per_band = (surface->h + nbands - 1) / nbands;
+	for (i = 0; i < nbands; i++) {
+		bands[i].first = i * rows_per_band;
+		bands[i].last = SDL_min((i + 1) * rows_per_band, surface->h);
+		bands[i].filtered = filtered + (rowbytes + 1) * bands[i].first;
+		bands[i].filtered_len = (rowbytes + 1) * (bands[i].last - bands[i].first);
+	}
+
+	/* Filter every band first; each band's deflate is primed with the end of
+	 * the previous band's filtered bytes. */
+	{
+		std::vector<std::thread> workers;
+		for (i = 0; i < nbands; i++) {
+			workers.emplace_back([=]() {
+				std::vector<Uint8> scratch(3 * rowbytes + 1);
+				png_filter_band(surface, options, strip, &bands[i], scratch.data());
+			});
+		}
+		for (auto &w : workers) w.join();
+	}
+	{
+		std::vector<std::thread> workers;
+		for (i = 0; i < nbands; i++) {
+			workers.emplace_back([=]() {
+				png_deflate_band(&bands[i], i > 0 ? &bands[i - 1] : NULL, level, i == nbands - 1);
+			});
+		}
+		for (auto &w : workers) w.join();
+	}
+
+	adler = bands[0].adler;
+	for (i = 1; i < nbands; i++)
+		adler = adler32_combine(adler, bands[i].adler, (z_off_t)bands[i].filtered_len);
+	png_put_be32(ztrailer, (Uint32)adler);
+
+	png_put_be32(ihdr, surface->w);
+	png_put_be32(ihdr + 4, surface->h);
+	ihdr[8] = 8;
+	ihdr[9] = (bpp == 4) ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB;
+	ihdr[10] = PNG_COMPRESSION_TYPE_DEFAULT;
+	ihdr[11] = PNG_FILTER_TYPE_DEFAULT;
+	ihdr[12] = PNG_INTERLACE_NONE;
+
+	for (i = 0; i < nbands; i++) {
+		if (!bands[i].ok) {
+			SDL_SetError("zlib failed to compress a PNG band\n");
+			result = ERROR;
+		}
+	}
+
+	if (result == 1) {
+		if (SDL_RWwrite(dst, signature, 1, 8) != 8
+		|| !png_write_chunk_SDL(dst, "IHDR", ihdr, 13)
+		|| !png_write_chunk_SDL(dst, "IDAT", zheader, 2))
+			result = ERROR;
+		for (i = 0; i < nbands && result == 1; i++)
+			if (!png_write_chunk_SDL(dst, "IDAT", bands[i].out, bands[i].out_len))
+				result = ERROR;
+		if (result == 1
+		&& (!png_write_chunk_SDL(dst, "IDAT", ztrailer, 4)
+		|| !png_write_chunk_SDL(dst, "IEND", NULL, 0)))
+			result = ERROR;
+		if (result == ERROR)
+			SDL_SetError("Failed writing PNG data\n");
+	}
+
+	for (i = 0; i < nbands; i++)
+		free(bands[i].out);
+	free(bands);
+	free(filtered);
+	return result;
+}
+
 int SDL_SavePNG_RW(SDL_Surface *surface, SDL_RWops *dst, int freedst) 
 {
+	return SDL_SavePNG_RW_Ex(surface, dst, freedst, NULL);
+}
+
+int SDL_SavePNG_RW_Ex(SDL_Surface *surface, SDL_RWops *dst, int freedst, const SDL_SavePNGOptions *options) 
+{
+	SDL_SavePNGOptions defaults = { 0 };
 	png_structp png_ptr;
 	png_infop info_ptr;
 	png_colorp pal_ptr;
 	SDL_Palette *pal;
-	int i, colortype;
+	int i, row, colortype;
+	png_reduction *reduction = NULL;
+	Uint8 *indexed = NULL;
+	size_t indexed_rowbytes = 0;
+	int strip = 0;
 #ifdef USE_ROW_POINTERS
 	png_bytep *row_pointers;
 #endif
+	if (!options) options = &defaults;
+
 	/* Initialize and do basic error checking */
 	if (!dst)
 	{
@@ -78,10 +573,47 @@ int SDL_SavePNG_RW(SDL_Surface *surface, SDL_RWops *dst, int freedst)
 		if (freedst) SDL_RWclose(dst);
 		return (ERROR);
 	}
+	if (options->reduce && png_is_rgba32(surface))
+	{
+		reduction = (png_reduction*)malloc(sizeof(png_reduction));
+		if (!reduction)
+		{
+			SDL_SetError("Out of memory for PNG colour reduction\n");
+			if (freedst) SDL_RWclose(dst);
+			return (ERROR);
+		}
+		if (png_reduce(surface, options, reduction))
+		{
+			indexed_rowbytes = ((size_t)surface->w * reduction->depth + 7) / 8;
+			indexed = (Uint8*)malloc(indexed_rowbytes * surface->h);
+			if (!indexed)
+			{
+				SDL_SetError("Out of memory for PNG colour reduction\n");
+				free(reduction);
+				if (freedst) SDL_RWclose(dst);
+				return (ERROR);
+			}
+			png_pack_indexed(surface, options, reduction, indexed, indexed_rowbytes);
+		}
+		strip = reduction->opaque;
+	}
+	if (options->threads > 1 && !indexed)
+	{
+		i = png_write_parallel(surface, dst, options, strip);
+		if (i != 0)
+		{
+			free(reduction);
+			if (freedst) SDL_RWclose(dst);
+			return (i == ERROR) ? (ERROR) : (SUCCESS);
+		}
+	}
+
 	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, png_error_SDL, NULL); /* err_ptr, err_fn, warn_fn */
 	if (!png_ptr) 
 	{
 		SDL_SetError("Unable to png_create_write_struct on %s\n", PNG_LIBPNG_VER_STRING);
+		free(indexed);
+		free(reduction);
 		if (freedst) SDL_RWclose(dst);
 		return (ERROR);
 	}
@@ -90,12 +622,16 @@ int SDL_SavePNG_RW(SDL_Surface *surface, SDL_RWops *dst, int freedst)
 	{
 		SDL_SetError("Unable to png_create_info_struct\n");
 		png_destroy_write_struct(&png_ptr, NULL);
+		free(indexed);
+		free(reduction);
 		if (freedst) SDL_RWclose(dst);
 		return (ERROR);
 	}
 	if (setjmp(png_jmpbuf(png_ptr)))	/* All other errors, see also "png_error_SDL" */
 	{
 		png_destroy_write_struct(&png_ptr, &info_ptr);
+		free(indexed);
+		free(reduction);
 		if (freedst) SDL_RWclose(dst);
 		return (ERROR);
 	}
@@ -103,6 +639,54 @@ int SDL_SavePNG_RW(SDL_Surface *surface, SDL_RWops *dst, int freedst)
 	/* Setup our RWops writer */
 	png_set_write_fn(png_ptr, dst, png_write_SDL, NULL); /* w_ptr, write_fn, flush_fn */
 
+	if (options->compression > 0)
+		png_set_compression_level(png_ptr, options->compression);
+
+	switch (options->filter) {
+		case SDL_SAVEPNG_FILTER_NONE:     png_set_filter(png_ptr, 0, PNG_FILTER_NONE); break;
+		case SDL_SAVEPNG_FILTER_SUB:      png_set_filter(png_ptr, 0, PNG_FILTER_SUB); break;
+		case SDL_SAVEPNG_FILTER_UP:       png_set_filter(png_ptr, 0, PNG_FILTER_UP); break;
+		case SDL_SAVEPNG_FILTER_AVERAGE:  png_set_filter(png_ptr, 0, PNG_FILTER_AVG); break;
+		case SDL_SAVEPNG_FILTER_PAETH:    png_set_filter(png_ptr, 0, PNG_FILTER_PAETH); break;
+		case SDL_SAVEPNG_FILTER_ADAPTIVE: png_set_filter(png_ptr, 0, PNG_ALL_FILTERS); break;
+		default: break;
+	}
+
+	if (indexed)
+	{
+		png_color colors[256];
+		png_byte trans[256];
+		Uint8 *c;
+		png_bytep *rows;
+
+		for (i = 0; i < reduction->palette.ncolors; i++) {
+			c = (Uint8*)&reduction->palette.colors[i];
+			colors[reduction->remap[i]].red   = c[0];
+			colors[reduction->remap[i]].green = c[1];
+			colors[reduction->remap[i]].blue  = c[2];
+			trans[reduction->remap[i]]        = c[3];
+		}
+		png_set_IHDR(png_ptr, info_ptr, surface->w, surface->h, reduction->depth, PNG_COLOR_TYPE_PALETTE,
+			PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_set_PLTE(png_ptr, info_ptr, colors, reduction->palette.ncolors);
+		if (reduction->ntrans)
+			png_set_tRNS(png_ptr, info_ptr, trans, reduction->ntrans, NULL);
+
+		png_write_info(png_ptr, info_ptr);
+		rows = (png_bytep*)malloc(sizeof(png_bytep) * surface->h);
+		for (i = 0; i < surface->h; i++)
+			rows[i] = indexed + i * indexed_rowbytes;
+		png_write_image(png_ptr, rows);
+		free(rows);
+		png_write_end(png_ptr, info_ptr);
+
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		free(indexed);
+		free(reduction);
+		if (freedst) SDL_RWclose(dst);
+		return (SUCCESS);
+	}
+
 	/* Prepare chunks */
 	colortype = PNG_COLOR_MASK_COLOR;
 	if (surface->format->BytesPerPixel > 0
@@ -119,7 +703,7 @@ int SDL_SavePNG_RW(SDL_Surface *surface, SDL_RWops *dst, int freedst)
 		png_set_PLTE(png_ptr, info_ptr, pal_ptr, pal->ncolors);
 		free(pal_ptr);
 	}
-	else if (surface->format->BytesPerPixel > 3 || surface->format->Amask)
+	else if (!strip && (surface->format->BytesPerPixel > 3 || surface->format->Amask))
 		colortype |= PNG_COLOR_MASK_ALPHA;
 
 	png_set_IHDR(png_ptr, info_ptr, surface->w, surface->h, 8, colortype,
@@ -135,20 +719,210 @@ int SDL_SavePNG_RW(SDL_Surface *surface, SDL_RWops *dst, int freedst)
 
 	/* Write everything */
 	png_write_info(png_ptr, info_ptr);
+
+	/* Every pixel is opaque; write RGB and skip the alpha bytes */
+	if (strip)
+		png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
+
 #ifdef USE_ROW_POINTERS
 	row_pointers = (png_bytep*) malloc(sizeof(png_bytep)*surface->h);
-	for (i = 0; i < surface->h; i++)
-		row_pointers[i] = (png_bytep)(Uint8*)surface->pixels + i * surface->pitch;
+	for (i = 0; i < surface->h; i++) {
+		row = options->flip ? surface->h - 1 - i : i;
+		row_pointers[i] = (png_bytep)(Uint8*)surface->pixels + row * surface->pitch;
+	}
 	png_write_image(png_ptr, row_pointers);
 	free(row_pointers);
 #else
-	for (i = 0; i < surface->h; i++)
-		png_write_row(png_ptr, (png_bytep)(Uint8*)surface->pixels + i * surface->pitch);
+	for (i = 0; i < surface->h; i++) {
+		row = options->flip ? surface->h - 1 - i : i;
+		png_write_row(png_ptr, (png_bytep)(Uint8*)surface->pixels + row * surface->pitch);
+	}
 #endif
 	png_write_end(png_ptr, info_ptr);
 
 	/* Done */
 	png_destroy_write_struct(&png_ptr, &info_ptr);
+	free(reduction);
 	if (freedst) SDL_RWclose(dst);
 	return (SUCCESS);
 }
+
+/* Animated PNG writer */
+struct SDL_APNGWriter
+{
+	SDL_RWops *dst;
+	int freedst;
+	int width;
+	int height;
+	SDL_SavePNGOptions options;
+	Sint64 actl_offset;
+	Uint32 frames;
+	Uint32 sequence;
+};
+
+static int png_write_actl(SDL_APNGWriter *writer)
+{
+	Uint8 actl[8];
+	png_put_be32(actl, writer->frames);
+	png_put_be32(actl + 4, 0); /* loop forever */
+	return png_write_chunk_SDL(writer->dst, "acTL", actl, 8);
+}
+
+SDL_APNGWriter *SDL_APNG_Begin(SDL_RWops *dst, int freedst, int width, int height, const SDL_SavePNGOptions *options)
+{
+	static const Uint8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	SDL_SavePNGOptions defaults = { 0 };
+	SDL_APNGWriter *writer;
+	Uint8 ihdr[13];
+
+	if (!dst)
+	{
+		SDL_SetError("Argument 1 to SDL_APNG_Begin can't be NULL, expecting SDL_RWops*\n");
+		return NULL;
+	}
+	writer = (SDL_APNGWriter*)calloc(1, sizeof(SDL_APNGWriter));
+	if (!writer)
+	{
+		SDL_SetError("Out of memory for APNG writer\n");
+		if (freedst) SDL_RWclose(dst);
+		return NULL;
+	}
+	writer->dst = dst;
+	writer->freedst = freedst;
+	writer->width = width;
+	writer->height = height;
+	writer->options = options ? *options : defaults;
+
+	png_put_be32(ihdr, width);
+	png_put_be32(ihdr + 4, height);
+	ihdr[8] = 8;
+	ihdr[9] = PNG_COLOR_TYPE_RGB_ALPHA;
+	ihdr[10] = PNG_COMPRESSION_TYPE_DEFAULT;
+	ihdr[11] = PNG_FILTER_TYPE_DEFAULT;
+	ihdr[12] = PNG_INTERLACE_NONE;
+
+	if (SDL_RWwrite(dst, signature, 1, 8) != 8 || !png_write_chunk_SDL(dst, "IHDR", ihdr, 13))
+	{
+		SDL_SetError("Failed writing APNG header\n");
+		if (freedst) SDL_RWclose(dst);
+		free(writer);
+		return NULL;
+	}
+
+	/* Reserve the animation control chunk; the frame count is filled in at the end */
+	writer->actl_offset = SDL_RWtell(dst);
+	if (writer->actl_offset < 0 || !png_write_actl(writer))
+	{
+		SDL_SetError("APNG output must be a seekable file\n");
+		if (freedst) SDL_RWclose(dst);
+		free(writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+int SDL_APNG_WriteFrame(SDL_APNGWriter *writer, SDL_Surface *surface, int x, int y, Uint16 delay_num, Uint16 delay_den)
+{
+	png_band band = { 0 };
+	Uint8 fctl[26], *scratch, *out;
+	size_t rowbytes;
+	uLongf out_len;
+	int level, result = SUCCESS;
+
+	if (!png_is_rgba32(surface))
+	{
+		SDL_SetError("APNG frames must be 32-bit RGBA surfaces\n");
+		return (ERROR);
+	}
+	if (x < 0 || y < 0 || x + surface->w > writer->width || y + surface->h > writer->height
+	|| (writer->frames == 0 && (surface->w != writer->width || surface->h != writer->height)))
+	{
+		SDL_SetError("APNG frame lies outside the canvas\n");
+		return (ERROR);
+	}
+
+	rowbytes = (size_t)surface->w * 4;
+	band.first = 0;
+	band.last = surface->h;
+	band.filtered_len = (rowbytes + 1) * surface->h;
+	band.filtered = (Uint8*)malloc(band.filtered_len);
+	scratch = (Uint8*)malloc(3 * rowbytes + 1);
+
+	/* Room in front of the data for the fdAT sequence number */
+	out_len = compressBound((uLong)band.filtered_len);
+	out = (Uint8*)malloc(4 + out_len);
+
+	if (!band.filtered || !scratch || !out)
+	{
+		free(band.filtered);
+		free(scratch);
+		free(out);
+		SDL_SetError("Out of memory for APNG frame\n");
+		return (ERROR);
+	}
+
+	png_filter_band(surface, &writer->options, 0, &band, scratch);
+	level = writer->options.compression > 0 ? writer->options.compression : Z_DEFAULT_COMPRESSION;
+	if (compress2(out + 4, &out_len, band.filtered, (uLong)band.filtered_len, level) != Z_OK)
+	{
+		SDL_SetError("zlib failed to compress an APNG frame\n");
+		result = ERROR;
+	}
+
+	if (result == SUCCESS)
+	{
+		png_put_be32(fctl, writer->sequence++);
+		png_put_be32(fctl + 4, surface->w);
+		png_put_be32(fctl + 8, surface->h);
+		png_put_be32(fctl + 12, x);
+		png_put_be32(fctl + 16, y);
+		fctl[20] = (Uint8)(delay_num >> 8);
+		fctl[21] = (Uint8)delay_num;
+		fctl[22] = (Uint8)(delay_den >> 8);
+		fctl[23] = (Uint8)delay_den;
+		fctl[24] = 0; /* APNG_DISPOSE_OP_NONE */
+		fctl[25] = 0; /* APNG_BLEND_OP_SOURCE */
+
+		if (!png_write_chunk_SDL(writer->dst, "fcTL", fctl, 26))
+			result = ERROR;
+		else if (writer->frames == 0) {
+			/* The first frame doubles as the default image */
+			if (!png_write_chunk_SDL(writer->dst, "IDAT", out + 4, out_len))
+				result = ERROR;
+		}
+		else {
+			png_put_be32(out, writer->sequence++);
+			if (!png_write_chunk_SDL(writer->dst, "fdAT", out, out_len + 4))
+				result = ERROR;
+		}
+
+		if (result == ERROR)
+			SDL_SetError("Failed writing APNG frame\n");
+		else
+			writer->frames++;
+	}
+
+	free(band.filtered);
+	free(scratch);
+	free(out);
+	return result;
+}
+
+int SDL_APNG_End(SDL_APNGWriter *writer)
+{
+	int result = SUCCESS;
+
+	if (SDL_RWseek(writer->dst, writer->actl_offset, RW_SEEK_SET) < 0
+	|| !png_write_actl(writer)
+	|| SDL_RWseek(writer->dst, 0, RW_SEEK_END) < 0
+	|| !png_write_chunk_SDL(writer->dst, "IEND", NULL, 0))
+	{
+		SDL_SetError("Failed finishing APNG\n");
+		result = ERROR;
+	}
+
+	if (writer->freedst) SDL_RWclose(writer->dst);
+	free(writer);
+	return result;
+}